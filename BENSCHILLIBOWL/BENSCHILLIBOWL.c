@@ -1,16 +1,73 @@
+#define _POSIX_C_SOURCE 200809L
 #include "BENSCHILLIBOWL.h"
+#include "workdeque.h"
+#include "restaurant_internal.h"
 
 #include <assert.h>
+#include <sched.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <time.h>
 #include <unistd.h>
 
 static bool IsEmpty(BENSCHILLIBOWL* bcb);
 static bool IsFull(BENSCHILLIBOWL* bcb);
-static void AddOrderToBack(Order **orders, Order *order);
+static void AddOrderToBack(BENSCHILLIBOWL* bcb, Order *order);
+static Order *RemoveOrderFromFront(BENSCHILLIBOWL* bcb);
+static void HeapPush(BENSCHILLIBOWL* bcb, Order *order);
+static Order *HeapPop(BENSCHILLIBOWL* bcb);
+static void CoalescePush(BENSCHILLIBOWL* bcb, Order *order);
+static int CoalescePop(BENSCHILLIBOWL* bcb, Order** out, int max);
+static int LockFreeAddOrders(BENSCHILLIBOWL* bcb, Order** orders, int n);
+static int LockFreeGetOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline);
+static bool LockFreeTryPush(BENSCHILLIBOWL* bcb, Order* order);
+static Order *LockFreeTryPop(BENSCHILLIBOWL* bcb);
+static bool LockFreeIsEmpty(BENSCHILLIBOWL* bcb);
+static bool OpenShards(BENSCHILLIBOWL* bcb, int num_shards, int max_size);
+static void CloseShards(BENSCHILLIBOWL* bcb);
+static int ShardedAddOrders(BENSCHILLIBOWL* bcb, Order** orders, int n);
+static int ShardedGetOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline);
+static int TakeOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline, int* left);
+static void FreeRestaurant(BENSCHILLIBOWL* bcb);
+static void LockRestaurant(BENSCHILLIBOWL* bcb);
+static uint64_t StatsWaitBegin(BENSCHILLIBOWL* bcb);
+static void StatsWaitEnd(BENSCHILLIBOWL* bcb, bool cook, uint64_t start);
+static void StatsBackToSleep(BENSCHILLIBOWL* bcb, bool *woke);
+static void StatsDepth(BENSCHILLIBOWL* bcb, int depth);
+static void PrintRestaurantStats(BENSCHILLIBOWL* bcb);
+static void FreeStatsBlocks(BENSCHILLIBOWL* bcb);
+static bool Spin(atomic_int *budget, bool (*ready)(BENSCHILLIBOWL*), BENSCHILLIBOWL* bcb,
+                 uint64_t deadline);
+static bool RelockIfRoom(BENSCHILLIBOWL* bcb);
+static bool RelockIfOrders(BENSCHILLIBOWL* bcb);
+static bool LockFreeHasRoom(BENSCHILLIBOWL* bcb);
+static bool LockFreeHasOrders(BENSCHILLIBOWL* bcb);
+static bool ShardedHasRoom(BENSCHILLIBOWL* bcb);
+static bool ShardedHasOrders(BENSCHILLIBOWL* bcb);
+
+/* constant false unless built with -DBENSCHILLIBOWL_STATS (make STATS=1),
+   so every stats call below folds away */
+#ifdef BENSCHILLIBOWL_STATS
+#define STATS_ON(bcb) ((bcb)->collect_stats)
+#else
+#define STATS_ON(bcb) false
+#endif
+
+/* WAIT_SPIN backoff budget, in rounds (see Spin) */
+#define SPIN_INITIAL_ROUNDS 16
+#define SPIN_MIN_ROUNDS 2
+#define SPIN_MAX_ROUNDS 64
+#define SPIN_YIELD_ROUND 7
+
+/* one waiting order in the QUEUE_PRIORITY heap */
+struct HeapEntry {
+    uint64_t due;
+    int order_number;
+    Order *order;
+};
 
 /* ----- Menu ----- */
-MenuItem BENSCHILLIBOWLMenu[] = {
+const char *BENSCHILLIBOWLMenu[] = {
     "BensChilli",
     "BensHalfSmoke",
     "BensHotDog",
@@ -22,103 +79,477 @@ MenuItem BENSCHILLIBOWLMenu[] = {
     "BensVeggieBurger",
     "BensOnionRings",
 };
-int BENSCHILLIBOWLMenuLength = 10;
+int BENSCHILLIBOWLMenuLength = BENSCHILLIBOWL_MENU_LENGTH;
+
+_Static_assert(sizeof(Order) == CACHE_LINE, "an Order should fill exactly one cache line");
 
 /* Select a random item from the Menu and return it */
 MenuItem PickRandomMenuItem() {
-    int idx = rand() % BENSCHILLIBOWLMenuLength;
-    return BENSCHILLIBOWLMenu[idx];
+    int idx = (int)RngBelow(ThreadRandom(), (uint32_t)BENSCHILLIBOWLMenuLength);
+    return (MenuItem)idx;
+}
+
+/* ----- Random numbers -----
+ * Every thread owns an Rng (rng.h) on stream `stream` of random_seed.
+ * Threads that don't pick a stream take the next one from
+ * RANDOM_AUTO_STREAM up, clear of any small explicit stream number.
+ */
+#define RANDOM_AUTO_STREAM (1ull << 63)
+
+static uint64_t random_seed;
+static bool random_seed_given;
+static pthread_once_t random_seed_once = PTHREAD_ONCE_INIT;
+static atomic_ullong random_next_stream = RANDOM_AUTO_STREAM;
+
+static _Thread_local bool thread_rng_seeded;
+static _Thread_local Rng thread_rng;
+
+static void PickRandomSeed(void) {
+    if (!random_seed_given) random_seed = RngDefaultSeed();
+}
+
+void SeedRandom(uint64_t seed) {
+    random_seed = seed;
+    random_seed_given = true;
+}
+
+void SeedThreadRandom(uint64_t stream) {
+    pthread_once(&random_seed_once, PickRandomSeed);
+    RngSeed(&thread_rng, random_seed, stream);
+    thread_rng_seeded = true;
+}
+
+Rng *ThreadRandom(void) {
+    if (!thread_rng_seeded) SeedThreadRandom(atomic_fetch_add(&random_next_stream, 1));
+    return &thread_rng;
+}
+
+const char* MenuItemName(MenuItem item) {
+    return BENSCHILLIBOWLMenu[item];
+}
+
+/* ----- Queue backends ----- */
+/* default per-class target latencies for QUEUE_PRIORITY */
+static const uint64_t DefaultPriorityTargetsNs[ORDER_PRIORITY_LEVELS] = {
+    [ORDER_PRIORITY_HIGH]   =   100 * 1000,
+    [ORDER_PRIORITY_NORMAL] =  1000 * 1000,
+    [ORDER_PRIORITY_LOW]    = 10000 * 1000,
+};
+
+static const char *QueueModeNames[] = {
+    [QUEUE_MUTEX]    = "mutex",
+    [QUEUE_LOCKFREE] = "lockfree",
+    [QUEUE_SHARDED]  = "sharded",
+    [QUEUE_PRIORITY] = "priority",
+    [QUEUE_COALESCE] = "coalesce",
+};
+
+const char* QueueModeName(QueueMode mode) {
+    return QueueModeNames[mode];
+}
+
+bool QueueModeFromName(const char* name, QueueMode* mode) {
+    for (int m = 0; m < (int)(sizeof(QueueModeNames) / sizeof(QueueModeNames[0])); m++) {
+        if (strcmp(name, QueueModeNames[m]) == 0) {
+            *mode = (QueueMode)m;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const char *WaitPolicyNames[] = {
+    [WAIT_PARK] = "park",
+    [WAIT_SPIN] = "spin",
+};
+
+const char* WaitPolicyName(WaitPolicy policy) {
+    return WaitPolicyNames[policy];
+}
+
+bool WaitPolicyFromName(const char* name, WaitPolicy* policy) {
+    for (int p = 0; p < (int)(sizeof(WaitPolicyNames) / sizeof(WaitPolicyNames[0])); p++) {
+        if (strcmp(name, WaitPolicyNames[p]) == 0) {
+            *policy = (WaitPolicy)p;
+            return true;
+        }
+    }
+    return false;
 }
 
 /* Allocate memory for the Restaurant, then create the mutex and condition variables */
 BENSCHILLIBOWL* OpenRestaurant(int max_size, int expected_num_orders) {
-    BENSCHILLIBOWL *bcb = (BENSCHILLIBOWL*)calloc(1, sizeof(BENSCHILLIBOWL));
+    return OpenRestaurantWithOptions(max_size, expected_num_orders, NULL);
+}
+
+BENSCHILLIBOWL* OpenRestaurantWithOptions(int max_size, int expected_num_orders,
+                                          const RestaurantOptions* opts) {
+    RestaurantOptions defaults = {0};
+    if (!opts) opts = &defaults;
+
+    /* the struct is cache-line aligned, which calloc doesn't guarantee */
+    BENSCHILLIBOWL *bcb = (BENSCHILLIBOWL*)aligned_alloc(_Alignof(BENSCHILLIBOWL),
+                                                         sizeof(BENSCHILLIBOWL));
     if (!bcb) return NULL;
+    memset(bcb, 0, sizeof(*bcb));
+    bcb->queue_mode = opts->queue_mode;
+    bcb->wait_policy = opts->wait_policy;
+    bcb->quiet = opts->quiet;
+    bcb->collect_stats = opts->collect_stats;
+    atomic_init(&bcb->stats_blocks, NULL);
+
+    /* each backend allocates only its own queue */
+    int num_slots = max_size > 0 ? max_size : 1;
+    if (bcb->queue_mode == QUEUE_MUTEX) {
+        /* fixed-capacity ring; enqueue/dequeue never walk the queue */
+        bcb->orders = (Order**)calloc(num_slots, sizeof(Order*));
+    }
+    if (bcb->queue_mode == QUEUE_LOCKFREE) {
+        /* one slot can't tell "published" from "free for the next lap" */
+        bcb->lf_slots = num_slots > 1 ? num_slots : 2;
+        bcb->slots = (LockFreeSlot*)calloc(bcb->lf_slots, sizeof(LockFreeSlot));
+    }
+    if (bcb->queue_mode == QUEUE_PRIORITY) {
+        bcb->heap = (struct HeapEntry*)calloc(num_slots, sizeof(*bcb->heap));
+    }
+
+    /* every order the restaurant expects comes out of one pre-sized pool */
+    if ((bcb->queue_mode == QUEUE_MUTEX && !bcb->orders) ||
+        (bcb->queue_mode == QUEUE_LOCKFREE && !bcb->slots) ||
+        (bcb->queue_mode == QUEUE_PRIORITY && !bcb->heap) ||
+        !OrderPoolInit(&bcb->pool, expected_num_orders)) {
+        free(bcb->heap);
+        free(bcb->slots);
+        free(bcb->orders);
+        free(bcb);
+        return NULL;
+    }
+    if (bcb->queue_mode == QUEUE_SHARDED && !OpenShards(bcb, opts->num_shards, max_size)) {
+        OrderPoolDestroy(&bcb->pool);
+        free(bcb->orders);
+        free(bcb);
+        return NULL;
+    }
 
-    bcb->orders               = NULL;     // empty queue
+    for (int p = 0; p < ORDER_PRIORITY_LEVELS; p++) {
+        bcb->priority_targets[p] = opts->priority_targets_ns[p]
+                                 ? opts->priority_targets_ns[p]
+                                 : DefaultPriorityTargetsNs[p];
+    }
+
+    bcb->head                 = 0;
+    bcb->tail                 = 0;
     bcb->current_size         = 0;
     bcb->max_size             = max_size;
     bcb->next_order_number    = 1;        // start order numbering at 1
     bcb->orders_handled       = 0;
     bcb->expected_num_orders  = expected_num_orders;
 
+    atomic_init(&bcb->customer_spin, SPIN_INITIAL_ROUNDS);
+    atomic_init(&bcb->cook_spin, SPIN_INITIAL_ROUNDS);
+
     pthread_mutex_init(&bcb->mutex, NULL);
     pthread_cond_init(&bcb->can_add_orders, NULL);
-    pthread_cond_init(&bcb->can_get_orders, NULL);
+    /* GetOrdersFor times its waits on the monotonic clock */
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setclock(&cattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&bcb->can_get_orders, &cattr);
+    pthread_condattr_destroy(&cattr);
 
-    /* seed RNG once per process (good enough for this simulation) */
-    srand((unsigned int)time(NULL) ^ (unsigned int)getpid());
+    if (bcb->queue_mode == QUEUE_LOCKFREE || bcb->queue_mode == QUEUE_SHARDED) {
+        /* slot i is first written by the producer that claims position i */
+        for (int i = 0; bcb->slots && i < bcb->lf_slots; i++) {
+            atomic_init(&bcb->slots[i].seq, (size_t)i);
+        }
+        atomic_init(&bcb->enqueue_pos, 0);
+        atomic_init(&bcb->dequeue_pos, 0);
+        atomic_init(&bcb->lf_next_order_number, 1);
+        atomic_init(&bcb->lf_orders_handled, 0);
+        EventCountInit(&bcb->not_full);
+        EventCountInit(&bcb->not_empty);
+    }
 
-    printf("Restaurant is open!\n");
+    if (!bcb->quiet) printf("Restaurant is open!\n");
     return bcb;
 }
 
 /* check that the number of orders received is equal to the number handled; free resources */
 void CloseRestaurant(BENSCHILLIBOWL* bcb) {
     /* No orders left in the system */
-    pthread_mutex_lock(&bcb->mutex);
-    assert(bcb->current_size == 0);
-    assert(bcb->orders_handled == bcb->expected_num_orders);
-    pthread_mutex_unlock(&bcb->mutex);
+    if (bcb->queue_mode == QUEUE_LOCKFREE) {
+        assert(LockFreeIsEmpty(bcb));
+        assert(atomic_load(&bcb->lf_orders_handled) == bcb->expected_num_orders);
+    } else if (bcb->queue_mode == QUEUE_SHARDED) {
+        assert(atomic_load(&bcb->sharded_size) == 0);
+        assert(atomic_load(&bcb->lf_orders_handled) == bcb->expected_num_orders);
+    } else {
+        pthread_mutex_lock(&bcb->mutex);
+        assert(bcb->current_size == 0);
+        assert(bcb->orders_handled == bcb->expected_num_orders);
+        pthread_mutex_unlock(&bcb->mutex);
+    }
+
+    if (STATS_ON(bcb)) PrintRestaurantStats(bcb);
+    bool quiet = bcb->quiet;
+    FreeRestaurant(bcb);
+    if (!quiet) printf("Restaurant is closed!\n");
+}
+
+/* tear down a restaurant that never got (or finished) its orders */
+void DiscardRestaurant(BENSCHILLIBOWL* bcb) {
+    FreeRestaurant(bcb);
+}
+
+/* everything CloseRestaurant frees, without its checks */
+static void FreeRestaurant(BENSCHILLIBOWL* bcb) {
+    FreeStatsBlocks(bcb);
 
     pthread_mutex_destroy(&bcb->mutex);
     pthread_cond_destroy(&bcb->can_add_orders);
     pthread_cond_destroy(&bcb->can_get_orders);
 
+    CloseShards(bcb);
+    OrderPoolDestroy(&bcb->pool);
+    free(bcb->heap);
+    free(bcb->slots);
+    free(bcb->orders);
     free(bcb);
-    printf("Restaurant is closed!\n");
+}
+
+/* take a blank order from the restaurant's pool */
+Order *AcquireOrder(BENSCHILLIBOWL* bcb) {
+    Order *order = OrderPoolGet(&bcb->pool);
+    if (order) {
+        order->order_number = 0;
+        order->enqueued_at = 0;
+        order->deadline = 0;
+        order->priority = ORDER_PRIORITY_NORMAL;
+        order->next = NULL;
+        atomic_store_explicit(&order->done, ORDER_PENDING, memory_order_relaxed);
+    }
+    return order;
+}
+
+/* give a fulfilled order back to the pool */
+void ReleaseOrder(BENSCHILLIBOWL* bcb, Order* order) {
+    OrderPoolPut(&bcb->pool, order);
+}
+
+/* ----- Completion -----
+ * Order.done is a per-order futex word. A waiter turns PENDING into
+ * PENDING_WAITERS before sleeping, so CompleteOrder only makes the wake
+ * syscall when someone may be asleep. The wake touches the order after
+ * its customer may already have seen DONE and released it; that is safe
+ * because pooled orders stay mapped until the restaurant closes, and a
+ * stray wake only makes some later waiter recheck its word.
+ */
+void CompleteOrder(BENSCHILLIBOWL* bcb, Order* order) {
+    (void)bcb;
+    if (atomic_exchange_explicit(&order->done, ORDER_DONE, memory_order_acq_rel) ==
+        ORDER_PENDING_WAITERS) {
+        FutexWake(&order->done, INT_MAX);
+    }
+}
+
+bool PollOrder(Order* order) {
+    return atomic_load_explicit(&order->done, memory_order_acquire) == ORDER_DONE;
+}
+
+void WaitOrder(Order* order) {
+    unsigned v = atomic_load_explicit(&order->done, memory_order_acquire);
+    while (v != ORDER_DONE) {
+        if (v == ORDER_PENDING &&
+            !atomic_compare_exchange_weak_explicit(&order->done, &v, ORDER_PENDING_WAITERS,
+                                                   memory_order_acquire,
+                                                   memory_order_acquire)) {
+            continue;  // v was reloaded
+        }
+        FutexWait(&order->done, ORDER_PENDING_WAITERS);
+        v = atomic_load_explicit(&order->done, memory_order_acquire);
+    }
+}
+
+/* one WaitOrder per order: orders already done when reached cost a load */
+void WaitOrders(Order** orders, int n) {
+    for (int i = 0; i < n; i++) WaitOrder(orders[i]);
 }
 
 /* add an order to the back of queue */
 int AddOrder(BENSCHILLIBOWL* bcb, Order* order) {
-    pthread_mutex_lock(&bcb->mutex);
+    return AddOrders(bcb, &order, 1);
+}
 
-    /* wait until not full */
-    while (IsFull(bcb)) {
-        pthread_cond_wait(&bcb->can_add_orders, &bcb->mutex);
+/* remove an order from the queue; NULL when everything is done */
+Order *GetOrder(BENSCHILLIBOWL* bcb) {
+    Order *order = NULL;
+    return GetOrders(bcb, &order, 1) == 1 ? order : NULL;
+}
+
+/* add n orders with contiguous order numbers, as many per lock hold as fit */
+int AddOrders(BENSCHILLIBOWL* bcb, Order** orders, int n) {
+    if (n <= 0) return 0;
+    if (bcb->queue_mode == QUEUE_LOCKFREE) return LockFreeAddOrders(bcb, orders, n);
+    if (bcb->queue_mode == QUEUE_SHARDED) return ShardedAddOrders(bcb, orders, n);
+
+    /* the priority heap needs to know when each order arrived */
+    if (bcb->queue_mode == QUEUE_PRIORITY) {
+        uint64_t now = NowNs();
+        for (int i = 0; i < n; i++) {
+            if (orders[i]->enqueued_at == 0) orders[i]->enqueued_at = now;
+        }
     }
 
-    /* assign order number and enqueue */
-    order->order_number = bcb->next_order_number++;
-    order->next = NULL;
-    AddOrderToBack(&bcb->orders, order);
-    bcb->current_size++;
+    LockRestaurant(bcb);
+
+    /* reserve the whole number range up front so it stays contiguous
+       even if we have to wait for room part way through */
+    int first = bcb->next_order_number;
+    bcb->next_order_number += n;
+
+    int added = 0;
+    while (added < n) {
+        /* wait until not full */
+        bool woke = false;
+        while (IsFull(bcb)) {
+            if (bcb->wait_policy == WAIT_SPIN) {
+                pthread_mutex_unlock(&bcb->mutex);
+                if (!Spin(&bcb->customer_spin, RelockIfRoom, bcb, 0)) LockRestaurant(bcb);
+                if (!IsFull(bcb)) break;
+            }
+            StatsBackToSleep(bcb, &woke);
+            bcb->waiting_customers++;
+            uint64_t start = StatsWaitBegin(bcb);
+            pthread_cond_wait(&bcb->can_add_orders, &bcb->mutex);
+            StatsWaitEnd(bcb, false, start);
+            bcb->waiting_customers--;
+            woke = true;
+        }
+
+        int room = bcb->max_size - bcb->current_size;
+        int batch = (n - added < room) ? n - added : room;
+        for (int i = 0; i < batch; i++) {
+            Order *order = orders[added + i];
+            order->order_number = first + added + i;
+            order->next = NULL;
+            StatsDepth(bcb, bcb->current_size);
+            if (bcb->queue_mode == QUEUE_PRIORITY) {
+                HeapPush(bcb, order);
+            } else if (bcb->queue_mode == QUEUE_COALESCE) {
+                CoalescePush(bcb, order);
+            } else {
+                AddOrderToBack(bcb, order);
+            }
+        }
+        added += batch;
 
-    /* wake a waiting cook */
-    pthread_cond_signal(&bcb->can_get_orders);
+        /* wake at most one waiting cook per new order */
+        WakeWaiters(&bcb->can_get_orders, bcb->waiting_cooks, batch);
+    }
     pthread_mutex_unlock(&bcb->mutex);
 
-    return order->order_number;
+    /* the orders may already be cooked and freed; don't touch them again */
+    return first;
 }
 
-/* remove an order from the queue; NULL when everything is done */
-Order *GetOrder(BENSCHILLIBOWL* bcb) {
-    pthread_mutex_lock(&bcb->mutex);
+/* remove up to max orders in one lock hold; 0 when everything is done */
+int GetOrders(BENSCHILLIBOWL* bcb, Order** out, int max) {
+    return TakeOrders(bcb, out, max, 0, NULL);
+}
+
+/* same, also saying how many orders are still queued */
+int GetOrdersLeft(BENSCHILLIBOWL* bcb, Order** out, int max, int* left) {
+    return TakeOrders(bcb, out, max, 0, left);
+}
+
+/* same, but -1 if no order turns up within timeout_ns */
+int GetOrdersFor(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t timeout_ns, int* left) {
+    return TakeOrders(bcb, out, max, NowNs() + timeout_ns, left);
+}
+
+/* GetOrders, giving up at deadline (CLOCK_MONOTONIC ns; 0 = never) and
+   setting *left (if left) to the orders still queued once it has taken */
+static int TakeOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline, int* left) {
+    if (left) *left = 0;
+    if (max <= 0) return 0;
+    if (bcb->queue_mode == QUEUE_LOCKFREE || bcb->queue_mode == QUEUE_SHARDED) {
+        int n = bcb->queue_mode == QUEUE_LOCKFREE ? LockFreeGetOrders(bcb, out, max, deadline)
+                                                 : ShardedGetOrders(bcb, out, max, deadline);
+        if (left && n > 0) *left = OrdersWaiting(bcb);  // two atomic loads, no lock
+        return n;
+    }
+
+    LockRestaurant(bcb);
 
     /* wait for orders while there will still be more work;
        stop when all expected orders have been handled and queue is empty */
+    bool woke = false;
     while (IsEmpty(bcb) && bcb->orders_handled < bcb->expected_num_orders) {
-        pthread_cond_wait(&bcb->can_get_orders, &bcb->mutex);
+        if (bcb->wait_policy == WAIT_SPIN) {
+            pthread_mutex_unlock(&bcb->mutex);
+            if (!Spin(&bcb->cook_spin, RelockIfOrders, bcb, deadline)) LockRestaurant(bcb);
+            if (!IsEmpty(bcb) || bcb->orders_handled >= bcb->expected_num_orders) break;
+        }
+        if (deadline && NowNs() >= deadline) {
+            pthread_mutex_unlock(&bcb->mutex);
+            return -1;
+        }
+        StatsBackToSleep(bcb, &woke);
+        bcb->waiting_cooks++;
+        uint64_t start = StatsWaitBegin(bcb);
+        if (deadline) {
+            struct timespec until = { (time_t)(deadline / 1000000000ull),
+                                      (long)(deadline % 1000000000ull) };
+            pthread_cond_timedwait(&bcb->can_get_orders, &bcb->mutex, &until);
+        } else {
+            pthread_cond_wait(&bcb->can_get_orders, &bcb->mutex);
+        }
+        StatsWaitEnd(bcb, true, start);
+        bcb->waiting_cooks--;
+        woke = true;
     }
 
     if (IsEmpty(bcb) && bcb->orders_handled >= bcb->expected_num_orders) {
-        /* Tell other cooks to wake up and also exit */
-        pthread_cond_broadcast(&bcb->can_get_orders);
+        /* Tell one idle cook to wake up and exit; it tells the next */
+        if (bcb->waiting_cooks > 0) pthread_cond_signal(&bcb->can_get_orders);
         pthread_mutex_unlock(&bcb->mutex);
-        return NULL;
+        return 0;
     }
 
     /* pop from front */
-    Order *front = bcb->orders;
-    bcb->orders = front->next;
-    bcb->current_size--;
-    bcb->orders_handled++;
+    int taken;
+    if (bcb->queue_mode == QUEUE_COALESCE) {
+        taken = CoalescePop(bcb, out, max);
+    } else {
+        taken = (max < bcb->current_size) ? max : bcb->current_size;
+        for (int i = 0; i < taken; i++) {
+            out[i] = (bcb->queue_mode == QUEUE_PRIORITY) ? HeapPop(bcb)
+                                                         : RemoveOrderFromFront(bcb);
+        }
+    }
+    bcb->orders_handled += taken;
+    if (left) *left = bcb->current_size;
 
-    /* a slot is free; wake a waiting customer */
-    pthread_cond_signal(&bcb->can_add_orders);
+    /* slots are free; wake at most one waiting customer per slot */
+    WakeWaiters(&bcb->can_add_orders, bcb->waiting_customers, taken);
     pthread_mutex_unlock(&bcb->mutex);
 
-    return front;
+    return taken;
+}
+
+/* orders queued right now; a snapshot for metrics */
+int OrdersWaiting(BENSCHILLIBOWL* bcb) {
+    if (bcb->queue_mode == QUEUE_LOCKFREE) {
+        size_t enqueued = atomic_load(&bcb->enqueue_pos);
+        size_t dequeued = atomic_load(&bcb->dequeue_pos);
+        return enqueued > dequeued ? (int)(enqueued - dequeued) : 0;
+    }
+    if (bcb->queue_mode == QUEUE_SHARDED) return atomic_load(&bcb->sharded_size);
+
+    pthread_mutex_lock(&bcb->mutex);
+    int size = bcb->current_size;
+    pthread_mutex_unlock(&bcb->mutex);
+    return size;
 }
 
 /* ----- helpers ----- */
@@ -130,13 +561,726 @@ static bool IsFull(BENSCHILLIBOWL* bcb) {
     return (bcb->current_size >= bcb->max_size);
 }
 
-/* append to singly-linked list queue (tail insert) */
-static void AddOrderToBack(Order **orders, Order *order) {
-    if (*orders == NULL) {
-        *orders = order;
+/* write into the slot at the tail of the ring (caller checked !IsFull) */
+static void AddOrderToBack(BENSCHILLIBOWL* bcb, Order *order) {
+    bcb->orders[bcb->tail] = order;
+    bcb->tail = (bcb->tail + 1) % bcb->max_size;
+    bcb->current_size++;
+}
+
+/* take the slot at the head of the ring (caller checked !IsEmpty) */
+static Order *RemoveOrderFromFront(BENSCHILLIBOWL* bcb) {
+    Order *front = bcb->orders[bcb->head];
+    bcb->orders[bcb->head] = NULL;
+    bcb->head = (bcb->head + 1) % bcb->max_size;
+    bcb->current_size--;
+    return front;
+}
+
+/* ----- contention stats -----
+ * Each thread that touches a restaurant with collect_stats gets its own
+ * cache-line-aligned StatsBlock, pushed onto bcb->stats_blocks with one
+ * CAS the first time. Only the owner writes a block, with relaxed atomic
+ * stores (plain adds on x86); GetRestaurantStats is the only place blocks
+ * are summed. Everything here sits behind STATS_ON().
+ */
+struct StatsBlock {
+    _Alignas(CACHE_LINE) RestaurantStats counters;
+    pthread_t owner;
+    struct StatsBlock *next;
+};
+
+/* counters are summed word by word */
+#define STATS_WORDS (sizeof(RestaurantStats) / sizeof(uint64_t))
+_Static_assert(sizeof(RestaurantStats) % sizeof(uint64_t) == 0,
+               "RestaurantStats should only hold uint64_t counters");
+
+// The calling thread's block in a given restaurant (keyed on the pool id,
+// like cook_home below).
+static _Thread_local struct {
+    unsigned long restaurant;
+    struct StatsBlock *block;
+} my_stats;
+
+/* if allocating a block fails, counts go here and are lost */
+static struct StatsBlock lost_stats;
+
+static RestaurantStats *ThreadStats(BENSCHILLIBOWL* bcb) {
+    if (my_stats.restaurant == bcb->pool.id) return &my_stats.block->counters;
+
+    /* a thread that moves between restaurants finds its old block again */
+    struct StatsBlock *block = atomic_load_explicit(&bcb->stats_blocks, memory_order_acquire);
+    while (block && !pthread_equal(block->owner, pthread_self())) block = block->next;
+    if (!block) {
+        block = (struct StatsBlock*)aligned_alloc(_Alignof(struct StatsBlock),
+                                                  sizeof(struct StatsBlock));
+        if (!block) return &lost_stats.counters;
+        memset(block, 0, sizeof(*block));
+        block->owner = pthread_self();
+        block->next = atomic_load_explicit(&bcb->stats_blocks, memory_order_relaxed);
+        while (!atomic_compare_exchange_weak_explicit(&bcb->stats_blocks, &block->next, block,
+                                                      memory_order_release,
+                                                      memory_order_relaxed)) {
+        }
+    }
+    my_stats.restaurant = bcb->pool.id;
+    my_stats.block = block;
+    return &block->counters;
+}
+
+/* take bcb->mutex, noting whether someone else already held it */
+static inline void LockRestaurant(BENSCHILLIBOWL* bcb) {
+    if (!STATS_ON(bcb)) {
+        pthread_mutex_lock(&bcb->mutex);
         return;
     }
-    Order *p = *orders;
-    while (p->next) p = p->next;
-    p->next = order;
+    RestaurantStats *st = ThreadStats(bcb);
+    if (pthread_mutex_trylock(&bcb->mutex) != 0) {
+        pthread_mutex_lock(&bcb->mutex);
+        StatAdd(&st->lock_contended, 1);
+    }
+    StatAdd(&st->lock_acquisitions, 1);
+}
+
+static inline uint64_t StatsWaitBegin(BENSCHILLIBOWL* bcb) {
+#ifndef BENSCHILLIBOWL_STATS
+    (void)bcb;  // STATS_ON doesn't look at it
+#endif
+    return STATS_ON(bcb) ? NowNs() : 0;
+}
+
+/* a customer (cook == false) or cook slept from start until now */
+static inline void StatsWaitEnd(BENSCHILLIBOWL* bcb, bool cook, uint64_t start) {
+    if (!STATS_ON(bcb)) return;
+    RestaurantStats *st = ThreadStats(bcb);
+    uint64_t waited = NowNs() - start;
+    StatAdd(cook ? &st->cook_waits : &st->customer_waits, 1);
+    StatAdd(cook ? &st->cook_wait_ns : &st->customer_wait_ns, waited);
+}
+
+/* about to sleep again: if we were woken last time round, it was for nothing */
+static inline void StatsBackToSleep(BENSCHILLIBOWL* bcb, bool *woke) {
+    if (!STATS_ON(bcb) || !*woke) return;
+    StatAdd(&ThreadStats(bcb)->spurious_wakeups, 1);
+    *woke = false;
+}
+
+/* an order was added behind depth others */
+static inline void StatsDepth(BENSCHILLIBOWL* bcb, int depth) {
+    if (!STATS_ON(bcb)) return;
+    int bucket = depth <= 0 ? 0 : 64 - __builtin_clzll((unsigned long long)depth);
+    if (bucket >= STATS_DEPTH_BUCKETS) bucket = STATS_DEPTH_BUCKETS - 1;
+    StatAdd(&ThreadStats(bcb)->depth[bucket], 1);
+}
+
+bool GetRestaurantStats(BENSCHILLIBOWL* bcb, RestaurantStats* out) {
+    memset(out, 0, sizeof(*out));
+    if (!STATS_ON(bcb)) return false;
+
+    uint64_t *sum = (uint64_t*)out;
+    struct StatsBlock *block = atomic_load_explicit(&bcb->stats_blocks, memory_order_acquire);
+    for (; block; block = block->next) {
+        uint64_t *words = (uint64_t*)&block->counters;
+        for (size_t i = 0; i < STATS_WORDS; i++) {
+            sum[i] += StatLoad(&words[i]);
+        }
+    }
+    return true;
+}
+
+/* dumped on stderr so it never mixes with a program's own output */
+static void PrintRestaurantStats(BENSCHILLIBOWL* bcb) {
+    RestaurantStats st;
+    GetRestaurantStats(bcb, &st);
+
+    fprintf(stderr, "Restaurant stats (%s):\n", QueueModeName(bcb->queue_mode));
+    fprintf(stderr, "  lock acquisitions: %llu (%llu contended)\n",
+            (unsigned long long)st.lock_acquisitions, (unsigned long long)st.lock_contended);
+    fprintf(stderr, "  customer waits:    %llu (%.3f ms)\n",
+            (unsigned long long)st.customer_waits, st.customer_wait_ns / 1e6);
+    fprintf(stderr, "  cook waits:        %llu (%.3f ms)\n",
+            (unsigned long long)st.cook_waits, st.cook_wait_ns / 1e6);
+    fprintf(stderr, "  spurious wakeups:  %llu\n", (unsigned long long)st.spurious_wakeups);
+    fprintf(stderr, "  queue depth seen by new orders:\n");
+    for (int b = 0; b < STATS_DEPTH_BUCKETS; b++) {
+        if (st.depth[b] == 0) continue;
+        long lo = b == 0 ? 0 : 1L << (b - 1), hi = b == 0 ? 0 : (1L << b) - 1;
+        fprintf(stderr, "    %6ld-%-6ld %llu\n", lo, hi, (unsigned long long)st.depth[b]);
+    }
+}
+
+static void FreeStatsBlocks(BENSCHILLIBOWL* bcb) {
+    struct StatsBlock *block = atomic_exchange(&bcb->stats_blocks, NULL);
+    while (block) {
+        struct StatsBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+/* ----- spin-then-park -----
+ * Under WAIT_SPIN a thread that would sleep first retries for up to a
+ * budget of backoff rounds: round r pauses the CPU 2^r times, and rounds
+ * past SPIN_YIELD_ROUND yield the CPU instead. Each side of the queue has
+ * its own budget, which steers towards twice the round spinning usually
+ * succeeds in and shrinks by a quarter every time spinning gives up, so
+ * waits that are always long stop costing spins. Budget updates race
+ * harmlessly; they are hints.
+ */
+static inline void CpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/* back off until ready(bcb), the budget is spent or deadline (0 = none)
+   passes; true if it got ready */
+static bool Spin(atomic_int *budget, bool (*ready)(BENSCHILLIBOWL*), BENSCHILLIBOWL* bcb,
+                 uint64_t deadline) {
+    /* with one CPU nothing changes while we pause; only yielding can help */
+    static atomic_int ncpus;
+    int cpus = atomic_load_explicit(&ncpus, memory_order_relaxed);
+    if (cpus == 0) {
+        cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        atomic_store_explicit(&ncpus, cpus, memory_order_relaxed);
+    }
+    bool uniprocessor = cpus == 1;
+
+    int limit = atomic_load_explicit(budget, memory_order_relaxed);
+    int next = limit - limit / 4;
+    bool got_ready = false;
+
+    for (int round = 0; round < limit; round++) {
+        /* out of time says nothing about spinning: leave the budget be */
+        if (deadline && NowNs() >= deadline) return false;
+        if (round < SPIN_YIELD_ROUND && !uniprocessor) {
+            for (int i = 0; i < 1 << round; i++) CpuRelax();
+        } else {
+            sched_yield();
+        }
+        if (ready(bcb)) {
+            next = (3 * limit + 2 * (round + 1) + 3) / 4;
+            got_ready = true;
+            break;
+        }
+    }
+
+    if (next < SPIN_MIN_ROUNDS) next = SPIN_MIN_ROUNDS;
+    if (next > SPIN_MAX_ROUNDS) next = SPIN_MAX_ROUNDS;
+    if (next != limit) atomic_store_explicit(budget, next, memory_order_relaxed);
+    return got_ready;
+}
+
+/* the mutex-based backends re-check under the lock and keep it on success */
+static bool RelockIfRoom(BENSCHILLIBOWL* bcb) {
+    LockRestaurant(bcb);
+    if (!IsFull(bcb)) return true;
+    pthread_mutex_unlock(&bcb->mutex);
+    return false;
+}
+
+static bool RelockIfOrders(BENSCHILLIBOWL* bcb) {
+    LockRestaurant(bcb);
+    if (!IsEmpty(bcb) || bcb->orders_handled >= bcb->expected_num_orders) return true;
+    pthread_mutex_unlock(&bcb->mutex);
+    return false;
+}
+
+static bool LockFreeHasRoom(BENSCHILLIBOWL* bcb) {
+    size_t out = atomic_load(&bcb->dequeue_pos);
+    return atomic_load(&bcb->enqueue_pos) - out < (size_t)bcb->lf_slots;
+}
+
+static bool LockFreeHasOrders(BENSCHILLIBOWL* bcb) {
+    return !LockFreeIsEmpty(bcb) ||
+           atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders;
+}
+
+static bool ShardedHasRoom(BENSCHILLIBOWL* bcb) {
+    return atomic_load(&bcb->sharded_size) < bcb->max_size;
+}
+
+static bool ShardedHasOrders(BENSCHILLIBOWL* bcb) {
+    return atomic_load(&bcb->sharded_queued) > 0 ||
+           atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders;
+}
+
+/* ----- priority backend -----
+ * QUEUE_PRIORITY keeps waiting orders in a binary min-heap (under
+ * bcb->mutex, current_size entries) keyed on when each order is due: its
+ * deadline if it has one, otherwise its enqueue time plus its class's
+ * target latency. Keys never change once pushed, yet low-priority orders
+ * still age upward: after its target has passed, an old LOW order is due
+ * before any HIGH order that arrives from then on, so it cannot starve.
+ * Equal keys go out in order-number order. Push and pop are O(log n).
+ */
+static bool HeapBefore(const struct HeapEntry *a, const struct HeapEntry *b) {
+    return a->due < b->due || (a->due == b->due && a->order_number < b->order_number);
+}
+
+static void HeapPush(BENSCHILLIBOWL* bcb, Order *order) {
+    int prio = order->priority < ORDER_PRIORITY_LEVELS ? order->priority
+                                                       : ORDER_PRIORITY_NORMAL;
+    struct HeapEntry entry = {
+        .due = order->deadline ? order->deadline
+                               : order->enqueued_at + bcb->priority_targets[prio],
+        .order_number = order->order_number,
+        .order = order,
+    };
+
+    /* sift up from the new last slot */
+    int i = bcb->current_size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!HeapBefore(&entry, &bcb->heap[parent])) break;
+        bcb->heap[i] = bcb->heap[parent];
+        i = parent;
+    }
+    bcb->heap[i] = entry;
+}
+
+static Order *HeapPop(BENSCHILLIBOWL* bcb) {
+    Order *top = bcb->heap[0].order;
+    int n = --bcb->current_size;
+    struct HeapEntry last = bcb->heap[n];
+
+    /* sift the old last entry down from the root */
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && HeapBefore(&bcb->heap[child + 1], &bcb->heap[child])) child++;
+        if (!HeapBefore(&bcb->heap[child], &last)) break;
+        bcb->heap[i] = bcb->heap[child];
+        i = child;
+    }
+    if (n > 0) bcb->heap[i] = last;
+    return top;
+}
+
+/* ----- coalescing backend -----
+ * QUEUE_COALESCE keeps one FIFO per menu item, indexed by the item, and a
+ * ring of the items that have orders waiting. A cook takes the item at the
+ * front of the ring and up to max of its oldest orders; if any are left,
+ * the item goes to the back, so items take turns and none starves. Finding
+ * a batch is O(1) and taking it O(batch): nothing is ever scanned.
+ * Orders of one item leave in the order they arrived.
+ */
+static void CoalescePush(BENSCHILLIBOWL* bcb, Order *order) {
+    assert(order->menu_item < BENSCHILLIBOWL_MENU_LENGTH);
+    ItemQueue *q = &bcb->items[order->menu_item];
+    if (q->tail) {
+        q->tail->next = order;
+    } else {
+        q->head = order;
+        /* the item had nothing waiting: it joins the back of the ring */
+        int back = (bcb->ready_head + bcb->ready_count++) % BENSCHILLIBOWL_MENU_LENGTH;
+        bcb->ready_items[back] = order->menu_item;
+    }
+    q->tail = order;
+    bcb->current_size++;
+}
+
+static int CoalescePop(BENSCHILLIBOWL* bcb, Order** out, int max) {
+    if (bcb->ready_count == 0) return 0;
+    int item = bcb->ready_items[bcb->ready_head];
+    bcb->ready_head = (bcb->ready_head + 1) % BENSCHILLIBOWL_MENU_LENGTH;
+    bcb->ready_count--;
+
+    ItemQueue *q = &bcb->items[item];
+    int taken = 0;
+    while (taken < max && q->head) {
+        Order *order = q->head;
+        q->head = order->next;
+        order->next = NULL;
+        out[taken++] = order;
+    }
+    if (q->head) {
+        int back = (bcb->ready_head + bcb->ready_count++) % BENSCHILLIBOWL_MENU_LENGTH;
+        bcb->ready_items[back] = (uint8_t)item;
+    } else {
+        q->tail = NULL;
+    }
+    bcb->current_size -= taken;
+    return taken;
+}
+
+/* ----- lock-free backend -----
+ * Bounded MPMC ring with a sequence number per slot (Vyukov). A producer
+ * owns slot pos % lf_slots once slot.seq == pos, a consumer once
+ * slot.seq == pos + 1. Nobody takes a lock; threads only park on an
+ * eventcount when the ring is really full or empty.
+ */
+static bool LockFreeTryPush(BENSCHILLIBOWL* bcb, Order* order) {
+    size_t pos = atomic_load_explicit(&bcb->enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        LockFreeSlot *slot = &bcb->slots[pos % (size_t)bcb->lf_slots];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&bcb->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->order = order;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return true;
+            }
+        } else if (dif < 0) {
+            return false;  /* slot still holds last lap's order: full */
+        } else {
+            pos = atomic_load_explicit(&bcb->enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+static Order *LockFreeTryPop(BENSCHILLIBOWL* bcb) {
+    size_t pos = atomic_load_explicit(&bcb->dequeue_pos, memory_order_relaxed);
+    for (;;) {
+        LockFreeSlot *slot = &bcb->slots[pos % (size_t)bcb->lf_slots];
+        size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (dif == 0) {
+            if (atomic_compare_exchange_weak_explicit(&bcb->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                Order *order = slot->order;
+                atomic_store_explicit(&slot->seq, pos + (size_t)bcb->lf_slots,
+                                      memory_order_release);
+                return order;
+            }
+        } else if (dif < 0) {
+            return NULL;  /* nothing published here yet: empty */
+        } else {
+            pos = atomic_load_explicit(&bcb->dequeue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+/* true when every claimed position has also been consumed */
+static bool LockFreeIsEmpty(BENSCHILLIBOWL* bcb) {
+    return atomic_load(&bcb->dequeue_pos) == atomic_load(&bcb->enqueue_pos);
+}
+
+static int LockFreeAddOrders(BENSCHILLIBOWL* bcb, Order** orders, int n) {
+    int first = atomic_fetch_add_explicit(&bcb->lf_next_order_number, n,
+                                          memory_order_relaxed);
+    int unannounced = 0;
+    for (int i = 0; i < n; i++) {
+        Order *order = orders[i];
+        order->order_number = first + i;
+        order->next = NULL;
+
+        bool woke = false;
+        while (!LockFreeTryPush(bcb, order)) {
+            StatsBackToSleep(bcb, &woke);
+            /* cooks must hear about what we already published before we
+               sleep, or nobody may ever make room for us */
+            if (unannounced > 0) {
+                EventCountNotify(&bcb->not_empty, unannounced);
+                unannounced = 0;
+            }
+            if (bcb->wait_policy == WAIT_SPIN &&
+                Spin(&bcb->customer_spin, LockFreeHasRoom, bcb, 0)) {
+                continue;
+            }
+            unsigned key = EventCountPrepare(&bcb->not_full);
+            if (LockFreeTryPush(bcb, order)) {
+                EventCountCancel(&bcb->not_full);
+                break;
+            }
+            uint64_t start = StatsWaitBegin(bcb);
+            EventCountWait(&bcb->not_full, key);
+            StatsWaitEnd(bcb, false, start);
+            woke = true;
+        }
+        if (STATS_ON(bcb)) {
+            /* dequeue_pos first, so the difference can't go negative */
+            size_t out = atomic_load(&bcb->dequeue_pos);
+            StatsDepth(bcb, (int)(atomic_load(&bcb->enqueue_pos) - out) - 1);
+        }
+        unannounced++;
+    }
+
+    EventCountNotify(&bcb->not_empty, unannounced);
+    return first;
+}
+
+static int LockFreeGetOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline) {
+    bool woke = false;
+    for (;;) {
+        int taken = 0;
+        while (taken < max && (out[taken] = LockFreeTryPop(bcb)) != NULL) {
+            taken++;
+        }
+        if (taken > 0) {
+            int handled = atomic_fetch_add(&bcb->lf_orders_handled, taken) + taken;
+            EventCountNotify(&bcb->not_full, taken);
+            if (handled == bcb->expected_num_orders) {
+                /* that was the last one; start sending idle cooks home */
+                EventCountNotify(&bcb->not_empty, 1);
+            }
+            return taken;
+        }
+        if (atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders) {
+            /* going home: wake the next idle cook so it can too */
+            EventCountNotify(&bcb->not_empty, 1);
+            return 0;
+        }
+
+        if (bcb->wait_policy == WAIT_SPIN && Spin(&bcb->cook_spin, LockFreeHasOrders, bcb, deadline)) {
+            continue;
+        }
+        uint64_t now = deadline ? NowNs() : 0;
+        if (deadline && now >= deadline) return -1;
+        StatsBackToSleep(bcb, &woke);
+        unsigned key = EventCountPrepare(&bcb->not_empty);
+        if (!LockFreeIsEmpty(bcb) ||
+            atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders) {
+            /* an order is being published (or we're done); retry */
+            EventCountCancel(&bcb->not_empty);
+            continue;
+        }
+        uint64_t start = StatsWaitBegin(bcb);
+        if (deadline) EventCountWaitFor(&bcb->not_empty, key, deadline - now);
+        else EventCountWait(&bcb->not_empty, key);
+        StatsWaitEnd(bcb, true, start);
+        woke = true;
+    }
+}
+
+/* ----- sharded backend -----
+ * Every cook owns a shard: a Chase-Lev deque only it pushes to and pops
+ * from, and an inbox that customers push orders onto (a lock-free stack
+ * that is always taken whole, with one exchange). Customers deal their
+ * orders to shards by customer_id. A cook whose shard is empty steals
+ * from the other deques, then from the other inboxes, before parking.
+ */
+struct CookShard {
+    _Atomic(Order*) inbox;  /* alone on its line: WorkDeque is line-aligned */
+    WorkDeque deque;
+};
+
+// The shard the calling cook owns in a given restaurant (the pool id
+// doubles as the restaurant's id). -1 when there are more cooks than
+// shards; such a cook only steals.
+static _Thread_local struct {
+    unsigned long restaurant;
+    int shard;
+} cook_home;
+
+static bool OpenShards(BENSCHILLIBOWL* bcb, int num_shards, int max_size) {
+    if (num_shards <= 0) num_shards = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_shards <= 0) num_shards = 1;
+
+    bcb->shards = (struct CookShard*)aligned_alloc(_Alignof(struct CookShard),
+                                                   num_shards * sizeof(struct CookShard));
+    if (!bcb->shards) return false;
+    memset(bcb->shards, 0, num_shards * sizeof(struct CookShard));
+    for (int i = 0; i < num_shards; i++) {
+        atomic_init(&bcb->shards[i].inbox, NULL);
+        /* in-flight orders never exceed max_size, so no deque can overflow */
+        if (!WorkDequeInit(&bcb->shards[i].deque, max_size > 0 ? max_size : 1)) {
+            while (--i >= 0) WorkDequeDestroy(&bcb->shards[i].deque);
+            free(bcb->shards);
+            bcb->shards = NULL;
+            return false;
+        }
+    }
+    bcb->num_shards = num_shards;
+    atomic_init(&bcb->shards_claimed, 0);
+    atomic_init(&bcb->sharded_size, 0);
+    atomic_init(&bcb->sharded_queued, 0);
+    return true;
+}
+
+static void CloseShards(BENSCHILLIBOWL* bcb) {
+    for (int i = 0; i < bcb->num_shards; i++) {
+        WorkDequeDestroy(&bcb->shards[i].deque);
+    }
+    free(bcb->shards);
+    bcb->shards = NULL;
+    bcb->num_shards = 0;
+}
+
+static int ShardOfCook(BENSCHILLIBOWL* bcb) {
+    if (cook_home.restaurant != bcb->pool.id) {
+        int claimed = atomic_fetch_add(&bcb->shards_claimed, 1);
+        cook_home.restaurant = bcb->pool.id;
+        cook_home.shard = claimed < bcb->num_shards ? claimed : -1;
+    }
+    return cook_home.shard;
+}
+
+/* claim room for up to want orders, waiting while the restaurant is full */
+static int ShardedReserve(BENSCHILLIBOWL* bcb, int want) {
+    bool woke = false;
+    for (;;) {
+        int size = atomic_load(&bcb->sharded_size);
+        while (size < bcb->max_size) {
+            int room = bcb->max_size - size;
+            int k = want < room ? want : room;
+            if (atomic_compare_exchange_weak(&bcb->sharded_size, &size, size + k)) {
+                for (int i = 0; i < k && STATS_ON(bcb); i++) StatsDepth(bcb, size + i);
+                return k;
+            }
+        }
+
+        if (bcb->wait_policy == WAIT_SPIN && Spin(&bcb->customer_spin, ShardedHasRoom, bcb, 0)) {
+            continue;
+        }
+        StatsBackToSleep(bcb, &woke);
+        unsigned key = EventCountPrepare(&bcb->not_full);
+        if (atomic_load(&bcb->sharded_size) < bcb->max_size) {
+            EventCountCancel(&bcb->not_full);
+            continue;
+        }
+        uint64_t start = StatsWaitBegin(bcb);
+        EventCountWait(&bcb->not_full, key);
+        StatsWaitEnd(bcb, false, start);
+        woke = true;
+    }
+}
+
+static int ShardedAddOrders(BENSCHILLIBOWL* bcb, Order** orders, int n) {
+    int first = atomic_fetch_add_explicit(&bcb->lf_next_order_number, n,
+                                          memory_order_relaxed);
+    struct CookShard *shard =
+        &bcb->shards[(unsigned)orders[0]->customer_id % (unsigned)bcb->num_shards];
+
+    int added = 0;
+    while (added < n) {
+        int k = ShardedReserve(bcb, n - added);
+
+        /* chain the k orders newest first and push the chain in one CAS */
+        Order *chain = NULL, *last = NULL;
+        for (int i = added; i < added + k; i++) {
+            Order *order = orders[i];
+            order->order_number = first + i;
+            order->next = chain;
+            if (!chain) last = order;
+            chain = order;
+        }
+        Order *head = atomic_load_explicit(&shard->inbox, memory_order_relaxed);
+        do {
+            last->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&shard->inbox, &head, chain,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+        added += k;
+
+        atomic_fetch_add(&bcb->sharded_queued, k);
+        EventCountNotify(&bcb->not_empty, k);
+    }
+    return first;
+}
+
+/* take a whole inbox: keep up to max of its oldest orders and stash the
+   rest in our own deque (or, with no shard of our own, back in the inbox) */
+static int TakeInbox(struct CookShard *victim, struct CookShard *mine, Order** out, int max) {
+    Order *list = atomic_exchange_explicit(&victim->inbox, NULL, memory_order_acquire);
+    if (!list) return 0;
+
+    Order *oldest_first = NULL;
+    while (list) {
+        Order *next = list->next;
+        list->next = oldest_first;
+        oldest_first = list;
+        list = next;
+    }
+
+    int taken = 0;
+    while (oldest_first && taken < max) {
+        out[taken++] = oldest_first;
+        oldest_first = oldest_first->next;
+    }
+    if (!oldest_first) return taken;
+
+    if (mine) {
+        while (oldest_first) {
+            Order *next = oldest_first->next;
+            WorkDequePush(&mine->deque, oldest_first);
+            oldest_first = next;
+        }
+    } else {
+        Order *last = oldest_first;
+        while (last->next) last = last->next;
+        Order *head = atomic_load_explicit(&victim->inbox, memory_order_relaxed);
+        do {
+            last->next = head;
+        } while (!atomic_compare_exchange_weak_explicit(&victim->inbox, &head, oldest_first,
+                                                        memory_order_release,
+                                                        memory_order_relaxed));
+    }
+    return taken;
+}
+
+static int ShardedTryTake(BENSCHILLIBOWL* bcb, int home, Order** out, int max) {
+    struct CookShard *mine = home >= 0 ? &bcb->shards[home] : NULL;
+    int start = home >= 0 ? home : 0;
+    int taken = 0;
+
+    if (mine) {
+        while (taken < max && (out[taken] = WorkDequePop(&mine->deque)) != NULL) taken++;
+        if (taken > 0) return taken;
+        taken = TakeInbox(mine, mine, out, max);
+        if (taken > 0) return taken;
+    }
+
+    /* nothing at home: steal queued work first, then fresh inboxes */
+    for (int i = 1; i <= bcb->num_shards; i++) {
+        struct CookShard *victim = &bcb->shards[(start + i) % bcb->num_shards];
+        while (taken < max && (out[taken] = WorkDequeSteal(&victim->deque)) != NULL) taken++;
+        if (taken > 0) return taken;
+    }
+    for (int i = 1; i <= bcb->num_shards; i++) {
+        struct CookShard *victim = &bcb->shards[(start + i) % bcb->num_shards];
+        taken = TakeInbox(victim, mine, out, max);
+        if (taken > 0) return taken;
+    }
+    return 0;
+}
+
+static int ShardedGetOrders(BENSCHILLIBOWL* bcb, Order** out, int max, uint64_t deadline) {
+    int home = ShardOfCook(bcb);
+    bool woke = false;
+    for (;;) {
+        int taken = ShardedTryTake(bcb, home, out, max);
+        if (taken > 0) {
+            atomic_fetch_sub(&bcb->sharded_queued, taken);
+            atomic_fetch_sub(&bcb->sharded_size, taken);
+            int handled = atomic_fetch_add(&bcb->lf_orders_handled, taken) + taken;
+            EventCountNotify(&bcb->not_full, taken);
+            if (handled == bcb->expected_num_orders) {
+                /* that was the last one; start sending idle cooks home */
+                EventCountNotify(&bcb->not_empty, 1);
+            }
+            return taken;
+        }
+        if (atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders) {
+            /* going home: wake the next idle cook so it can too */
+            EventCountNotify(&bcb->not_empty, 1);
+            return 0;
+        }
+
+        if (bcb->wait_policy == WAIT_SPIN && Spin(&bcb->cook_spin, ShardedHasOrders, bcb, deadline)) {
+            continue;
+        }
+        uint64_t now = deadline ? NowNs() : 0;
+        if (deadline && now >= deadline) return -1;
+        StatsBackToSleep(bcb, &woke);
+        unsigned key = EventCountPrepare(&bcb->not_empty);
+        if (atomic_load(&bcb->sharded_queued) > 0 ||
+            atomic_load(&bcb->lf_orders_handled) >= bcb->expected_num_orders) {
+            /* an order is in flight between shards (or we're done); retry */
+            EventCountCancel(&bcb->not_empty);
+            continue;
+        }
+        uint64_t start = StatsWaitBegin(bcb);
+        if (deadline) EventCountWaitFor(&bcb->not_empty, key, deadline - now);
+        else EventCountWait(&bcb->not_empty, key);
+        StatsWaitEnd(bcb, true, start);
+        woke = true;
+    }
 }
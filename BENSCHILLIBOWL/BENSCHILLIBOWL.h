@@ -6,46 +6,248 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <stdint.h>
 
-// Let a menu item be a string.
-typedef char* MenuItem;
+#include "eventcount.h"
+#include "orderpool.h"
+#include "rng.h"
 
-// Contents of an Order.
+// Size of a cache line; hot fields that different threads write are kept
+// on separate lines.
+#define CACHE_LINE 64
+
+// Let a menu item be an index into the menu (see MenuItemName).
+typedef enum {
+    BENS_CHILLI,
+    BENS_HALF_SMOKE,
+    BENS_HOT_DOG,
+    BENS_CHILLI_CHEESE_FRIES,
+    BENS_SHAKE,
+    BENS_HOT_CAKES,
+    BENS_CAKE,
+    BENS_HAMBURGER,
+    BENS_VEGGIE_BURGER,
+    BENS_ONION_RINGS,
+    BENSCHILLIBOWL_MENU_LENGTH
+} MenuItem;
+
+// Priority classes, most urgent first. Under QUEUE_PRIORITY each class
+// has a target latency (see RestaurantOptions.priority_targets_ns).
+typedef enum {
+    ORDER_PRIORITY_HIGH,
+    ORDER_PRIORITY_NORMAL,
+    ORDER_PRIORITY_LOW,
+    ORDER_PRIORITY_LEVELS
+} OrderPriority;
+
+// Contents of an Order: one cache-line-aligned record, so two orders
+// never share a line. menu_item holds a MenuItem and priority an
+// OrderPriority. Times are CLOCK_MONOTONIC ns: enqueued_at may be set by
+// the submitter (QUEUE_PRIORITY fills it in if left 0), and deadline is
+// optional (0 = none). done is the order's completion word, a futex that
+// CompleteOrder sets and WaitOrder sleeps on (see ORDER_PENDING).
 typedef struct OrderStruct {
-    MenuItem menu_item;
+    _Alignas(CACHE_LINE) struct OrderStruct *next;
     int customer_id;
     int order_number;
-    struct OrderStruct *next;
+    uint8_t menu_item;
+    uint8_t priority;
+    atomic_uint done;
+    uint64_t enqueued_at;
+    uint64_t deadline;
 } Order;
 
+// Values of Order.done.
+enum {
+    ORDER_PENDING,          // not fulfilled yet
+    ORDER_DONE,             // fulfilled: the order is its customer's again
+    ORDER_PENDING_WAITERS,  // not fulfilled, and someone sleeps on it
+};
+
+// Queue backends a restaurant can be opened with.
+typedef enum {
+    QUEUE_MUTEX,     // ring guarded by the mutex + condition variables (default)
+    QUEUE_LOCKFREE,  // bounded lock-free MPMC ring, futex parking when full/empty
+    QUEUE_SHARDED,   // one work-stealing deque per cook, futex parking
+    QUEUE_PRIORITY,  // most urgent order first (deadline heap), mutex + condvars
+    QUEUE_COALESCE,  // GetOrders hands out orders for one menu item at a time, mutex + condvars
+} QueueMode;
+
+// What a customer or cook does when it has to wait for room or orders.
+typedef enum {
+    WAIT_PARK,  // sleep right away (default)
+    WAIT_SPIN,  // retry with pause/yield backoff for a self-tuning budget, then sleep
+} WaitPolicy;
+
+// Options for OpenRestaurantWithOptions(). All-zero means the defaults.
+typedef struct {
+    QueueMode queue_mode;
+    WaitPolicy wait_policy;
+    int num_shards;  // QUEUE_SHARDED: number of cook shards (0 = one per CPU)
+    bool quiet;      // don't print the open/closed banners
+    // QUEUE_PRIORITY: how long an order of each class may wait before it
+    // is due, in ns (0 = default: 100us / 1ms / 10ms for high/normal/low)
+    uint64_t priority_targets_ns[ORDER_PRIORITY_LEVELS];
+    // collect contention counters (see GetRestaurantStats). Only honoured
+    // when built with -DBENSCHILLIBOWL_STATS (make STATS=1); otherwise the
+    // instrumentation is compiled out entirely.
+    bool collect_stats;
+} RestaurantOptions;
+
+// Buckets of RestaurantStats.depth: bucket 0 counts an empty queue, bucket
+// b > 0 depths in [2^(b-1), 2^b).
+#define STATS_DEPTH_BUCKETS 32
+
+// Contention counters, summed over every thread that used the restaurant.
+// Lock counts only apply to the mutex-based backends (QUEUE_MUTEX,
+// QUEUE_PRIORITY, QUEUE_COALESCE); waits count both condition variable and futex sleeps.
+typedef struct {
+    uint64_t lock_acquisitions;
+    uint64_t lock_contended;     // the mutex was already held by someone
+    uint64_t customer_waits;     // sleeps because the restaurant was full
+    uint64_t customer_wait_ns;
+    uint64_t cook_waits;         // sleeps because it was empty
+    uint64_t cook_wait_ns;
+    uint64_t spurious_wakeups;   // woke up only to find nothing had changed
+    uint64_t depth[STATS_DEPTH_BUCKETS];  // queue depth each order found
+} RestaurantStats;
+
+struct CookShard;
+struct HeapEntry;
+struct StatsBlock;
+
+// QUEUE_COALESCE: the orders waiting for one menu item, oldest first,
+// chained through Order.next.
+typedef struct {
+    Order *head;
+    Order *tail;
+} ItemQueue;
+
+// One slot of the lock-free ring. seq tells producers and consumers
+// whose turn it is to touch the slot.
+typedef struct {
+    atomic_size_t seq;
+    Order *order;
+} LockFreeSlot;
+
 // A restuarant contains:
-//  - An array of orders
+//  - Its configuration, then synchronization objects, producer-side state
+//    and consumer-side state, each group on its own cache line(s)
+//  - A ring of orders (max_size slots, consumed at head, filled at tail),
+//    or for QUEUE_PRIORITY a heap of them ordered by when each is due
 //  - its current size (the number of orders currently handled by the restaurant)
 //  - its max size (the maximum number of orders the restaurant can handle)
 //  - The order number of the upcoming order
 //  - The number of orders fulfilled
 //  - The number of orders the restaurant expects to fulfill
+//  - How many customers / cooks are blocked, so wakeups can be targeted
+//  - Under WAIT_SPIN, how many backoff rounds each side currently spins
+//    for before sleeping (adjusted as waits succeed or fail)
+//  - A pool the restaurant's Orders are allocated from
 //  - Synchronization objects:
 //    - A lock, required to modify any part of the restaurant
 //    - condition variables, used to ensure the restaurant is only
 //      modified when it is able to receive orders (not full)
 //      or fulfill orders (not empty).
+//  - For QUEUE_LOCKFREE, its own slots, positions and counters instead;
+//    the fields above are then unused. The ring needs at least two slots,
+//    so a max size of 1 admits 2 orders there.
+//  - For QUEUE_SHARDED, one shard per cook plus the same counters and
+//    eventcounts as QUEUE_LOCKFREE. sharded_size counts orders accepted
+//    but not yet taken (bounded by max_size); sharded_queued counts the
+//    ones already visible to cooks.
+//  - For QUEUE_COALESCE, one FIFO of orders per menu item instead of the
+//    ring, and a ring of the items that have orders waiting (each at most
+//    once), in the order they are to be served; current_size still counts
+//    every waiting order.
+//  - With collect_stats, the per-thread counter blocks registered so far
 typedef struct Restaurant {
-    Order* orders;
-    int current_size;
+    /* set by OpenRestaurant, read-only afterwards */
+    QueueMode queue_mode;
+    WaitPolicy wait_policy;
+    bool quiet;
     int max_size;
+	int expected_num_orders;
+    int num_shards;
+    uint64_t priority_targets[ORDER_PRIORITY_LEVELS];
+    Order** orders;  /* only QUEUE_MUTEX has this ring */
+    struct HeapEntry *heap;
+    LockFreeSlot *slots;
+    int lf_slots;
+    struct CookShard *shards;
+    bool collect_stats;
+    _Atomic(struct StatsBlock*) stats_blocks;  /* pushed once per thread */
+
+    /* synchronization: each object on its own line */
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    int waiting_customers;
+    int waiting_cooks;
+    _Alignas(CACHE_LINE) pthread_cond_t can_add_orders;
+    _Alignas(CACHE_LINE) pthread_cond_t can_get_orders;
+    _Alignas(CACHE_LINE) EventCount not_full;
+    _Alignas(CACHE_LINE) EventCount not_empty;
+
+    /* producer side: written by AddOrder(s) */
+    _Alignas(CACHE_LINE) int tail;
+    int current_size;
     int next_order_number;
+    atomic_size_t enqueue_pos;
+    atomic_int lf_next_order_number;
+    atomic_int customer_spin;
+
+    /* consumer side: written by GetOrder(s) */
+    _Alignas(CACHE_LINE) int head;
     int orders_handled;
-	int expected_num_orders;
-    pthread_mutex_t mutex;
-    pthread_cond_t can_add_orders, can_get_orders;
+    atomic_size_t dequeue_pos;
+    atomic_int lf_orders_handled;
+    atomic_int cook_spin;
+
+    /* QUEUE_COALESCE sub-queues, under the mutex */
+    _Alignas(CACHE_LINE) ItemQueue items[BENSCHILLIBOWL_MENU_LENGTH];
+    uint8_t ready_items[BENSCHILLIBOWL_MENU_LENGTH];
+    int ready_head;
+    int ready_count;
+
+    /* QUEUE_SHARDED bookkeeping, written by both sides */
+    _Alignas(CACHE_LINE) atomic_int sharded_size;
+    atomic_int sharded_queued;
+    atomic_int shards_claimed;
+
+    _Alignas(CACHE_LINE) OrderPool pool;
 } BENSCHILLIBOWL;
 
 /**
- * Picks a random menu item and returns it.
+ * Picks a random menu item and returns it, from the calling thread's
+ * generator (see ThreadRandom).
  */
 MenuItem PickRandomMenuItem();
 
+/**
+ * Sets the seed every thread's generator derives from. Call it before any
+ * thread draws, e.g. for a repeatable --seed run; without it the seed is
+ * picked from the clock and pid on the first draw.
+ */
+void SeedRandom(uint64_t seed);
+
+/**
+ * Puts the calling thread on stream `stream` of the seed (see rng.h), so
+ * with a fixed seed it draws the same numbers on every run. A thread that
+ * never calls this gets a stream of its own on its first draw.
+ */
+void SeedThreadRandom(uint64_t stream);
+
+/**
+ * The calling thread's generator. Nothing in it is shared, so drawing
+ * from it never contends with other threads.
+ */
+Rng *ThreadRandom(void);
+
+/**
+ * Returns the printable name of a menu item, e.g. "BensChilli".
+ */
+const char* MenuItemName(MenuItem item);
+
 /**
  * Creates a restaurant with a maximum size and the expected number of orders.
  * Returns the restaurant.
@@ -57,14 +259,85 @@ MenuItem PickRandomMenuItem();
  */
 BENSCHILLIBOWL* OpenRestaurant(int max_size, int expected_num_orders);
 
+/**
+ * Same as OpenRestaurant, but lets the caller pick the queue backend.
+ * opts may be NULL for the defaults.
+ */
+BENSCHILLIBOWL* OpenRestaurantWithOptions(int max_size, int expected_num_orders,
+                                          const RestaurantOptions* opts);
+
+/**
+ * Maps a queue backend to its name ("mutex", "lockfree", "sharded",
+ * "priority", "coalesce") and back.
+ * QueueModeFromName returns false for an unknown name.
+ */
+const char* QueueModeName(QueueMode mode);
+bool QueueModeFromName(const char* name, QueueMode* mode);
+
+/**
+ * Same for wait policies ("park", "spin").
+ */
+const char* WaitPolicyName(WaitPolicy policy);
+bool WaitPolicyFromName(const char* name, WaitPolicy* policy);
+
 /**
  * Closes the restaurant. This function should:
  *  - ensure all orders have been fulfilled
  *  - ensure the number of orders fulfilled matches the expected number of orders
+ *  - print its contention counters, if it collected any
  *  - destroy all the synchronization objects
- *  - free the space of the restaurant
+ *  - free the space of the restaurant (including its order pool)
  */
 void CloseRestaurant(BENSCHILLIBOWL* mcg);
+
+/**
+ * Frees the restaurant like CloseRestaurant, but without checking that
+ * every order was handled or printing anything: for giving up on a
+ * restaurant, e.g. when its cooks could not be started. Nobody may be
+ * using it any more.
+ */
+void DiscardRestaurant(BENSCHILLIBOWL* mcg);
+
+/**
+ * Takes a blank Order from the restaurant's pool. The pool is pre-sized
+ * for expected_num_orders, so this normally makes no heap calls.
+ * Returns NULL only if the pool had to grow and that failed.
+ */
+Order *AcquireOrder(BENSCHILLIBOWL* mcg);
+
+/**
+ * Returns an Order obtained from AcquireOrder to the pool. Any thread may
+ * release any order, e.g. the cook that fulfilled it.
+ */
+void ReleaseOrder(BENSCHILLIBOWL* mcg, Order* order);
+
+/**
+ * Cook side, instead of ReleaseOrder when the customer wants to know:
+ * marks the order fulfilled and wakes whoever waits on it. The order then
+ * belongs to its customer again, who releases it, so the cook must not
+ * touch it afterwards.
+ * Only the waiters of this one order are woken; nothing is broadcast and
+ * no restaurant lock is taken.
+ */
+void CompleteOrder(BENSCHILLIBOWL* mcg, Order* order);
+
+/**
+ * Returns true once the order has been completed; never blocks.
+ */
+bool PollOrder(Order* order);
+
+/**
+ * Sleeps until the order has been completed (returns at once if it has).
+ */
+void WaitOrder(Order* order);
+
+/**
+ * Waits until every one of orders[0..n-1] has been completed. It is
+ * WaitOrder on each order in turn, not one wait on the whole set: it
+ * returns as soon as the last one is done, but may sleep and be woken
+ * once per order that is still pending when its turn comes.
+ */
+void WaitOrders(Order** orders, int n);
   
 /**
  * Add an order to the restaurant. This function should:
@@ -79,11 +352,59 @@ int AddOrder(BENSCHILLIBOWL* mcg, Order* order);
  * Gets an order from the restaurant. This funtion should:
  *  - Wait until the restaurant is not empty
  *  - get an order from the front of the orders queue
+ *    (QUEUE_PRIORITY: the order that is due soonest)
  *  - return the order
  * 
  * If there are no orders left, this function should notify the other cooks
- * that there are no orders left.
+ * that there are no orders left: it wakes one idle cook, which wakes the
+ * next as it leaves, and so on.
  */
 Order *GetOrder(BENSCHILLIBOWL* mcg);
 
+/**
+ * Batched AddOrder. Adds orders[0..n-1] to the back of the queue, moving as
+ * many as fit per lock acquisition, and gives them contiguous order numbers.
+ * Returns the order number of orders[0].
+ */
+int AddOrders(BENSCHILLIBOWL* mcg, Order** orders, int n);
+
+/**
+ * Batched GetOrder. Waits until the restaurant is not empty, then takes up
+ * to max orders from the front of the queue into out. Under QUEUE_COALESCE
+ * they are the oldest orders for a single menu item, so a cook can make
+ * them all at once.
+ * Returns the number of orders taken; 0 means there are no orders left.
+ */
+int GetOrders(BENSCHILLIBOWL* mcg, Order** out, int max);
+
+/**
+ * GetOrders that also sets *left to how many orders were still queued
+ * once it had taken its own. The mutex backends read that while they
+ * hold the lock anyway, so unlike calling OrdersWaiting afterwards it
+ * costs no second lock round trip. 0 when it returns 0.
+ */
+int GetOrdersLeft(BENSCHILLIBOWL* mcg, Order** out, int max, int* left);
+
+/**
+ * GetOrders that gives up waiting after timeout_ns: returns -1 if the
+ * restaurant stayed empty (with orders still to come) that long, e.g.
+ * for a cook that goes home when idle (see cookpool.h). Sets *left as
+ * GetOrdersLeft does, if left is not NULL.
+ */
+int GetOrdersFor(BENSCHILLIBOWL* mcg, Order** out, int max, uint64_t timeout_ns, int* left);
+
+/**
+ * Returns how many orders are queued, waiting for a cook. A snapshot for
+ * metrics: other threads may change it as soon as it is read.
+ */
+int OrdersWaiting(BENSCHILLIBOWL* mcg);
+
+/**
+ * Sums every thread's contention counters into out. Threads only ever
+ * write their own cache-line-aligned block, so this is the one place the
+ * counters are merged; it may run while the restaurant is busy.
+ * Returns false (and zeroes out) if the restaurant isn't collecting stats.
+ */
+bool GetRestaurantStats(BENSCHILLIBOWL* mcg, RestaurantStats* out);
+
 #endif  // LAB3_BENSCHILLIBOWL_H_
\ No newline at end of file
@@ -0,0 +1,397 @@
+// bench.c — throughput / latency benchmark for the BENSCHILLIBOWL queue.
+//
+// Build:  make bench
+// Run:    ./bench [--backends mutex,lockfree,sharded,priority,coalesce] [--waits park,spin]
+//                 [--customers 1,4,16] [--cooks 1,4] [--sizes 16,256,4096]
+//                 [--orders N] [--batch B] [--repeat R] [--seed S] [--cook-ns C]
+//                 [--complete]
+//                 [--pipeline name:cooks:us[-us][:queue],... | --elastic MIN-MAX]
+//
+// Every combination of backend x wait policy x customers x cooks x size is
+// run R times.
+// Each customer submits N orders (B per AddOrders call) with no think
+// time, customer i at priority i % 3, drawing its menu items from stream i
+// of the seed (random unless --seed). Cooks pull up to B per GetOrders
+// call and record the time from just before the order was submitted to
+// when it was handed out. With --cook-ns, cooking a batch then costs C ns
+// (busy-waited) per distinct menu item in it, as when a kitchen makes
+// identical items together: the case QUEUE_COALESCE batches for.
+// With --complete, cooks hand orders back with CompleteOrder and each
+// customer waits for a batch to be done before submitting the next; the
+// latency is then end to end, submit to completion, as the customer sees it.
+// With --pipeline the cooks are the stages of a kitchen instead (see
+// ParseKitchen; service times are busy-waited, B orders per hand-off), the
+// cooks column is their total and latency runs until an order leaves the
+// last stage; each run's per-stage breakdown goes to stderr.
+// With --elastic the cooks are a pool that grows from MIN to MAX as the
+// queue backs up and shrinks back when idle (see cookpool.h); --cook-ns is
+// then busy-waited per order, the cooks column is MAX, latency is only
+// recorded under --complete, and each run's pool totals go to stderr.
+// One CSV row per run goes to stdout.
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "BENSCHILLIBOWL.h"
+#include "histogram.h"
+#include "kitchen.h"
+#include "cookpool.h"
+#include "restaurant_internal.h"
+
+#define MAX_LIST 16
+#define MAX_BATCH 64
+
+typedef struct {
+    int values[MAX_LIST];
+    int count;
+} IntList;
+
+typedef struct {
+    QueueMode backend;
+    WaitPolicy wait;
+    int customers;
+    int cooks;
+    int size;
+    int orders_per_customer;
+    int batch;
+    uint64_t cook_ns;         // cooking cost per distinct menu item in a batch
+    bool complete;            // customers wait for their orders (CompleteOrder / WaitOrders)
+    const StageSpec *stages;  // a kitchen instead of plain cooks, if num_stages > 0
+    int num_stages;
+    const CookPoolOptions *pool;  // an elastic cook pool instead of plain cooks, if set
+} RunConfig;
+
+typedef struct {
+    BENSCHILLIBOWL *bcb;
+    const RunConfig *cfg;
+    int id;
+    Histogram latency;
+} Worker;
+
+static void* Customer(void* arg) {
+    Worker *w = (Worker*)arg;
+    Order *ords[MAX_BATCH];
+    SeedThreadRandom((uint64_t)w->id);
+
+    for (int done = 0; done < w->cfg->orders_per_customer; ) {
+        int n = w->cfg->orders_per_customer - done;
+        if (n > w->cfg->batch) n = w->cfg->batch;
+
+        uint64_t now = NowNs();
+        for (int i = 0; i < n; i++) {
+            ords[i] = AcquireOrder(w->bcb);
+            if (!ords[i]) {
+                /* the cooks would wait forever for the orders we can't place */
+                fprintf(stderr, "run failed: out of memory for orders\n");
+                exit(1);
+            }
+            ords[i]->menu_item = PickRandomMenuItem();
+            ords[i]->customer_id = w->id;
+            ords[i]->priority = (uint8_t)(w->id % ORDER_PRIORITY_LEVELS);
+            ords[i]->enqueued_at = now;
+        }
+        AddOrders(w->bcb, ords, n);
+        done += n;
+
+        if (w->cfg->complete) {
+            WaitOrders(ords, n);
+            uint64_t finished = NowNs();
+            for (int i = 0; i < n; i++) {
+                HistogramRecord(&w->latency, finished - now);
+                ReleaseOrder(w->bcb, ords[i]);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* Cook(void* arg) {
+    Worker *w = (Worker*)arg;
+    Order *ords[MAX_BATCH];
+
+    for (;;) {
+        int n = GetOrders(w->bcb, ords, w->cfg->batch);
+        if (n == 0) break;
+
+        uint64_t now = NowNs();
+        unsigned items = 0;
+        for (int i = 0; i < n; i++) {
+            if (!w->cfg->complete) HistogramRecord(&w->latency, now - ords[i]->enqueued_at);
+            items |= 1u << ords[i]->menu_item;
+        }
+        if (w->cfg->cook_ns) {
+            uint64_t until = now + w->cfg->cook_ns * (uint64_t)__builtin_popcount(items);
+            while (NowNs() < until) {
+            }
+        }
+        for (int i = 0; i < n; i++) {
+            if (w->cfg->complete) CompleteOrder(w->bcb, ords[i]);
+            else ReleaseOrder(w->bcb, ords[i]);
+        }
+    }
+    return NULL;
+}
+
+/* the elastic pool's work: busy-wait *arg ns per order */
+static void SpinOrder(Order* order, void* arg) {
+    (void)order;
+    uint64_t until = NowNs() + *(const uint64_t*)arg;
+    while (NowNs() < until) {
+    }
+}
+
+/* one run; prints its CSV row. Returns false if it could not run. */
+static bool RunOnce(const RunConfig *cfg) {
+    RestaurantOptions opts = {0};
+    opts.queue_mode = cfg->backend;
+    opts.wait_policy = cfg->wait;
+    opts.num_shards = cfg->num_stages > 0 ? cfg->stages[0].cooks
+                    : cfg->pool ? cfg->pool->max_cooks : cfg->cooks;
+    opts.quiet = true;
+
+    int expected = cfg->customers * cfg->orders_per_customer;
+    int cook_threads = (cfg->num_stages > 0 || cfg->pool) ? 0 : cfg->cooks;
+    int nthreads = cfg->customers + cook_threads;
+    Worker *workers = calloc(nthreads, sizeof(Worker));
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    if (!workers || !threads) {
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    BENSCHILLIBOWL *bcb = OpenRestaurantWithOptions(cfg->size, expected, &opts);
+    if (!bcb) {
+        free(workers);
+        free(threads);
+        return false;
+    }
+
+    uint64_t start = NowNs();
+    Kitchen *kitchen = NULL;
+    CookPool *pool = NULL;
+    if ((cfg->num_stages > 0 && !(kitchen = OpenKitchen(bcb, cfg->stages, cfg->num_stages))) ||
+        (cfg->pool && !(pool = OpenCookPool(bcb, cfg->pool)))) {
+        DiscardRestaurant(bcb);  // none of its orders will ever come
+        free(workers);
+        free(threads);
+        return false;
+    }
+    for (int i = 0; i < nthreads; i++) {
+        workers[i].bcb = bcb;
+        workers[i].cfg = cfg;
+        workers[i].id = i;
+        HistogramReset(&workers[i].latency);
+        pthread_create(&threads[i], NULL, i < cook_threads ? Cook : Customer, &workers[i]);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    Histogram all;
+    HistogramReset(&all);
+    if (kitchen) {
+        WaitKitchen(kitchen);
+        if (!cfg->complete) GetKitchenLatency(kitchen, &all);
+    }
+    if (pool) WaitCookPool(pool);
+    uint64_t elapsed = NowNs() - start;
+    if (kitchen) {
+        PrintKitchenStats(kitchen, stderr);
+        CloseKitchen(kitchen);
+    }
+    if (pool) {
+        PrintCookPoolStats(pool, stderr);
+        CloseCookPool(pool);
+    }
+    CloseRestaurant(bcb);
+
+    /* whoever recorded latency: cooks, or customers under --complete */
+    for (int i = 0; i < nthreads; i++) {
+        HistogramMerge(&all, &workers[i].latency);
+    }
+
+    double seconds = (double)elapsed / 1e9;
+    printf("%s,%s,%d,%d,%d,%d,%d,%.6f,%.0f,%llu,%llu,%llu,%llu\n",
+           QueueModeName(cfg->backend), WaitPolicyName(cfg->wait), cfg->customers, cfg->cooks, cfg->size,
+           expected, cfg->batch, seconds, (double)expected / seconds,
+           (unsigned long long)HistogramPercentile(&all, 0.50),
+           (unsigned long long)HistogramPercentile(&all, 0.99),
+           (unsigned long long)HistogramPercentile(&all, 0.999),
+           (unsigned long long)all.max);
+    fflush(stdout);
+
+    free(workers);
+    free(threads);
+    return true;
+}
+
+/* "1,4,16" -> {1, 4, 16}; false on anything that isn't a positive int */
+static bool ParseIntList(const char *arg, IntList *out) {
+    out->count = 0;
+    char *copy = strdup(arg);
+    if (!copy) return false;
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        int v = atoi(tok);
+        if (v <= 0 || out->count == MAX_LIST) {
+            ok = false;
+            break;
+        }
+        out->values[out->count++] = v;
+    }
+    free(copy);
+    return ok && out->count > 0;
+}
+
+static bool ParseBackends(const char *arg, IntList *out) {
+    out->count = 0;
+    char *copy = strdup(arg);
+    if (!copy) return false;
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        QueueMode mode;
+        if (!QueueModeFromName(tok, &mode) || out->count == MAX_LIST) {
+            ok = false;
+            break;
+        }
+        out->values[out->count++] = (int)mode;
+    }
+    free(copy);
+    return ok && out->count > 0;
+}
+
+static bool ParseWaits(const char *arg, IntList *out) {
+    out->count = 0;
+    char *copy = strdup(arg);
+    if (!copy) return false;
+
+    bool ok = true;
+    for (char *tok = strtok(copy, ","); tok; tok = strtok(NULL, ",")) {
+        WaitPolicy policy;
+        if (!WaitPolicyFromName(tok, &policy) || out->count == MAX_LIST) {
+            ok = false;
+            break;
+        }
+        out->values[out->count++] = (int)policy;
+    }
+    free(copy);
+    return ok && out->count > 0;
+}
+
+static void Usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--backends mutex,lockfree,sharded,priority,coalesce] [--waits park,spin]\n"
+            "          [--customers 1,4,16] [--cooks 1,4] [--sizes 16,256,4096]\n"
+            "          [--orders N] [--batch B] [--repeat R] [--seed S] [--cook-ns C]\n"
+            "          [--complete]\n"
+            "          [--pipeline name:cooks:us[-us][:queue],... | --elastic MIN-MAX]\n", prog);
+}
+
+int main(int argc, char **argv) {
+    IntList backends = { { QUEUE_MUTEX, QUEUE_LOCKFREE, QUEUE_SHARDED }, 3 };
+    IntList waits = { { WAIT_PARK }, 1 };
+    IntList customers = { { 1, 4, 16 }, 3 };
+    IntList cooks = { { 1, 4 }, 2 };
+    IntList sizes = { { 16, 256, 4096 }, 3 };
+    int orders = 20000;
+    int batch = 1;
+    int repeat = 1;
+    long long cook_ns = 0;
+    bool complete = false;
+    StageSpec stages[KITCHEN_MAX_STAGES];
+    ServiceTime times[KITCHEN_MAX_STAGES];
+    int num_stages = 0;
+    CookPoolOptions pool = {0};
+
+    for (int i = 1; i < argc; i++) {
+        const char *opt = argv[i];
+        if (strcmp(opt, "--complete") == 0) {
+            complete = true;
+            continue;
+        }
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = val != NULL;
+        if (ok && strcmp(opt, "--backends") == 0) ok = ParseBackends(val, &backends);
+        else if (ok && strcmp(opt, "--waits") == 0) ok = ParseWaits(val, &waits);
+        else if (ok && strcmp(opt, "--customers") == 0) ok = ParseIntList(val, &customers);
+        else if (ok && strcmp(opt, "--cooks") == 0) ok = ParseIntList(val, &cooks);
+        else if (ok && strcmp(opt, "--sizes") == 0) ok = ParseIntList(val, &sizes);
+        else if (ok && strcmp(opt, "--orders") == 0) ok = (orders = atoi(val)) > 0;
+        else if (ok && strcmp(opt, "--batch") == 0) ok = (batch = atoi(val)) > 0 && batch <= MAX_BATCH;
+        else if (ok && strcmp(opt, "--repeat") == 0) ok = (repeat = atoi(val)) > 0;
+        else if (ok && strcmp(opt, "--cook-ns") == 0) ok = (cook_ns = atoll(val)) >= 0;
+        else if (ok && strcmp(opt, "--seed") == 0) SeedRandom(strtoull(val, NULL, 0));
+        else if (ok && strcmp(opt, "--pipeline") == 0) {
+            ok = (num_stages = ParseKitchen(val, stages, times, KITCHEN_MAX_STAGES, true)) > 0;
+        }
+        else if (ok && strcmp(opt, "--elastic") == 0) {
+            ok = sscanf(val, "%d-%d", &pool.min_cooks, &pool.max_cooks) == 2 &&
+                 pool.min_cooks > 0 && pool.max_cooks >= pool.min_cooks;
+        }
+        else ok = false;
+        ok = ok && !(num_stages > 0 && pool.min_cooks > 0);
+
+        if (!ok) {
+            Usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+
+    /* the kitchen's cooks replace the --cooks list */
+    int total_cooks = 0;
+    for (int s = 0; s < num_stages; s++) {
+        stages[s].batch = batch;
+        total_cooks += stages[s].cooks;
+    }
+    if (num_stages > 0) {
+        cooks = (IntList){ { total_cooks }, 1 };
+        stages[num_stages - 1].complete = complete;
+    }
+    /* and so does the pool's ceiling */
+    uint64_t order_ns = (uint64_t)cook_ns;
+    if (pool.min_cooks > 0) {
+        cooks = (IntList){ { pool.max_cooks }, 1 };
+        pool.batch = batch;
+        pool.work = cook_ns ? SpinOrder : NULL;
+        pool.arg = &order_ns;
+        pool.complete = complete;
+    }
+
+    printf("backend,wait,customers,cooks,queue_size,orders,batch,seconds,"
+           "orders_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+
+    for (int b = 0; b < backends.count; b++)
+    for (int w = 0; w < waits.count; w++)
+    for (int c = 0; c < customers.count; c++)
+    for (int k = 0; k < cooks.count; k++)
+    for (int s = 0; s < sizes.count; s++)
+    for (int r = 0; r < repeat; r++) {
+        RunConfig cfg = {
+            .backend = (QueueMode)backends.values[b],
+            .wait = (WaitPolicy)waits.values[w],
+            .customers = customers.values[c],
+            .cooks = cooks.values[k],
+            .size = sizes.values[s],
+            .orders_per_customer = orders,
+            .batch = batch,
+            .cook_ns = (uint64_t)cook_ns,
+            .complete = complete,
+            .stages = stages,
+            .num_stages = num_stages,
+            .pool = pool.min_cooks > 0 ? &pool : NULL,
+        };
+        if (!RunOnce(&cfg)) {
+            fprintf(stderr, "run failed: out of memory, or its cooks could not start\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 200809L
+#include "cookpool.h"
+#include "restaurant_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// Most orders a cook takes at once (CookPoolOptions.batch).
+#define COOKPOOL_MAX_BATCH 64
+
+// The pool. Cooks are detached threads. live only changes under mutex,
+// and the last cook out signals all_gone; cooks deciding whether to wait,
+// retire or scale up just read it. orders is on its own line so cooks
+// counting don't bounce the mutex's.
+struct CookPool {
+    BENSCHILLIBOWL *bcb;
+    CookPoolOptions opts;
+    pthread_mutex_t mutex;
+    pthread_cond_t all_gone;
+    atomic_int live;    // cooks started and not yet gone, including ones still starting
+    int peak;
+    uint64_t started;
+    uint64_t retired;
+    _Alignas(CACHE_LINE) atomic_ullong orders;
+};
+
+static void *PoolCookMain(void *arg);
+
+/* ----- head count ----- */
+/* start one more cook unless the pool is full; false if none started */
+static bool AddCook(CookPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    if (atomic_load(&pool->live) >= pool->opts.max_cooks) {
+        pthread_mutex_unlock(&pool->mutex);
+        return false;
+    }
+    /* count it now, so cooks deciding at the same time see it */
+    atomic_fetch_add(&pool->live, 1);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t thread;
+    bool ok = pthread_create(&thread, &attr, PoolCookMain, pool) == 0;
+    pthread_attr_destroy(&attr);
+
+    pthread_mutex_lock(&pool->mutex);
+    if (ok) {
+        pool->started++;
+        int live = atomic_load(&pool->live);
+        if (live > pool->peak) pool->peak = live;
+    } else {
+        atomic_fetch_sub(&pool->live, 1);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return ok;
+}
+
+/* a cook is leaving (mutex held); the last one out wakes WaitCookPool */
+static void CookGone(CookPool *pool) {
+    if (atomic_fetch_sub(&pool->live, 1) == 1) pthread_cond_broadcast(&pool->all_gone);
+}
+
+/* an idle cook may retire if that leaves at least min_cooks.
+   Once it has, the cook must not touch the pool. */
+static bool TryRetire(CookPool *pool) {
+    pthread_mutex_lock(&pool->mutex);
+    bool retire = atomic_load(&pool->live) > pool->opts.min_cooks;
+    if (retire) {
+        pool->retired++;
+        CookGone(pool);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return retire;
+}
+
+/* a snapshot: good enough for deciding, never for the head count */
+static int LiveCooks(CookPool *pool) {
+    return atomic_load_explicit(&pool->live, memory_order_relaxed);
+}
+
+/* is the queue falling behind the cooks there are? left is what the take
+   saw still queued, so deciding costs no extra trip to the queue */
+static bool ShouldScaleUp(CookPool *pool, Order **ords, int n, int left, uint64_t took_at) {
+    const CookPoolOptions *o = &pool->opts;
+    int live = LiveCooks(pool);
+    if (live >= o->max_cooks) return false;
+    if (left > o->scale_depth * live) return true;
+    if (o->scale_wait_ns == 0) return false;
+    for (int i = 0; i < n; i++) {
+        if (ords[i]->enqueued_at && took_at - ords[i]->enqueued_at > o->scale_wait_ns) return true;
+    }
+    return false;
+}
+
+/* ----- cooks ----- */
+static void *PoolCookMain(void *arg) {
+    CookPool *pool = (CookPool*)arg;
+    const CookPoolOptions *o = &pool->opts;
+    Order *ords[COOKPOOL_MAX_BATCH];
+
+    for (;;) {
+        /* only a cook that may retire stops waiting; the rest wait it out */
+        int left;
+        int n = LiveCooks(pool) > o->min_cooks
+                    ? GetOrdersFor(pool->bcb, ords, o->batch, o->linger_ns, &left)
+                    : GetOrdersLeft(pool->bcb, ords, o->batch, &left);
+        if (n < 0) {
+            /* idle for linger_ns with nothing in hand */
+            if (TryRetire(pool)) return NULL;
+            continue;
+        }
+        if (n == 0) break;  // no more work
+
+        if (ShouldScaleUp(pool, ords, n, left, NowNs())) AddCook(pool);
+
+        for (int i = 0; i < n; i++) {
+            if (o->work) o->work(ords[i], o->arg);
+            if (o->complete) CompleteOrder(pool->bcb, ords[i]);
+            else ReleaseOrder(pool->bcb, ords[i]);
+        }
+        atomic_fetch_add_explicit(&pool->orders, (unsigned long long)n, memory_order_relaxed);
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    CookGone(pool);
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+/* ----- pool ----- */
+CookPool *OpenCookPool(BENSCHILLIBOWL* bcb, const CookPoolOptions* opts) {
+    if (opts->min_cooks < 1 || opts->max_cooks < opts->min_cooks ||
+        opts->batch < 0 || opts->batch > COOKPOOL_MAX_BATCH || opts->scale_depth < 0) {
+        return NULL;
+    }
+
+    /* orders is cache-line aligned, which calloc doesn't guarantee */
+    CookPool *pool = (CookPool*)aligned_alloc(_Alignof(CookPool), sizeof(CookPool));
+    if (!pool) return NULL;
+    memset(pool, 0, sizeof(*pool));
+    pool->bcb = bcb;
+    pool->opts = *opts;
+    if (pool->opts.batch == 0) pool->opts.batch = 1;
+    if (pool->opts.scale_depth == 0) pool->opts.scale_depth = COOKPOOL_DEFAULT_SCALE_DEPTH;
+    if (pool->opts.linger_ns == 0) pool->opts.linger_ns = COOKPOOL_DEFAULT_LINGER_NS;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->all_gone, NULL);
+    atomic_init(&pool->live, 0);
+    atomic_init(&pool->orders, 0);
+
+    int started = 0;
+    for (int i = 0; i < opts->min_cooks; i++) {
+        if (AddCook(pool)) started++;
+    }
+    if (started == 0) {
+        pthread_cond_destroy(&pool->all_gone);
+        pthread_mutex_destroy(&pool->mutex);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void WaitCookPool(CookPool* pool) {
+    pthread_mutex_lock(&pool->mutex);
+    while (atomic_load(&pool->live) > 0) {
+        pthread_cond_wait(&pool->all_gone, &pool->mutex);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+void CloseCookPool(CookPool* pool) {
+    WaitCookPool(pool);
+    pthread_cond_destroy(&pool->all_gone);
+    pthread_mutex_destroy(&pool->mutex);
+    free(pool);
+}
+
+CookPoolStats GetCookPoolStats(CookPool* pool) {
+    CookPoolStats st;
+    pthread_mutex_lock(&pool->mutex);
+    st.cooks = atomic_load(&pool->live);
+    st.peak = pool->peak;
+    st.started = pool->started;
+    st.retired = pool->retired;
+    pthread_mutex_unlock(&pool->mutex);
+    st.orders = atomic_load_explicit(&pool->orders, memory_order_relaxed);
+    return st;
+}
+
+void PrintCookPoolStats(CookPool* pool, FILE* f) {
+    CookPoolStats st = GetCookPoolStats(pool);
+    fprintf(f, "Cook pool (%d-%d): %llu cooks started, %llu retired idle, peak %d working; "
+               "%llu orders, %.1f per cook\n",
+            pool->opts.min_cooks, pool->opts.max_cooks,
+            (unsigned long long)st.started, (unsigned long long)st.retired, st.peak,
+            (unsigned long long)st.orders,
+            st.started ? (double)st.orders / (double)st.started : 0.0);
+}
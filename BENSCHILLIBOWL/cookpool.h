@@ -0,0 +1,85 @@
+#ifndef LAB3_COOKPOOL_H_
+#define LAB3_COOKPOOL_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "BENSCHILLIBOWL.h"
+#include "kitchen.h"
+
+// A cook pool that the restaurant sizes for itself, between min_cooks and
+// max_cooks, instead of a fixed set of threads that live until GetOrders
+// returns 0.
+//  - It starts min_cooks cooks. After every take, a cook checks the queue:
+//    if more than scale_depth orders per cook are waiting, or the order it
+//    just took waited longer than scale_wait_ns, it starts another cook
+//    (while there are fewer than max_cooks).
+//  - A cook above min_cooks waits at most linger_ns for orders
+//    (GetOrdersFor); if none come it retires. The last min_cooks never do.
+//  - A cook only retires when it holds no orders and orders are still to
+//    come, and at least min_cooks >= 1 cooks stay until GetOrders returns
+//    0, so every order is still handled and CloseRestaurant's
+//    orders_handled == expected_num_orders check holds.
+#define COOKPOOL_DEFAULT_SCALE_DEPTH 4
+#define COOKPOOL_DEFAULT_LINGER_NS 10000000ull  // 10 ms
+
+typedef struct {
+    int min_cooks;           // always working (>= 1)
+    int max_cooks;           // never more than this (>= min_cooks)
+    int batch;               // orders a cook takes at once (0 = 1, max 64)
+    int scale_depth;         // add a cook when more than this many orders per cook wait
+                             // (0 = COOKPOOL_DEFAULT_SCALE_DEPTH)
+    uint64_t scale_wait_ns;  // ... or when an order waited longer than this (0 = never)
+    uint64_t linger_ns;      // an idle cook above min_cooks retires after this
+                             // (0 = COOKPOOL_DEFAULT_LINGER_NS)
+    StageWork work;          // what a cook does to each order; NULL = nothing
+    void *arg;
+    bool complete;           // hand orders back with CompleteOrder (their customers
+                             // wait for them) instead of releasing them
+} CookPoolOptions;
+
+// Totals so far. orders is summed over every cook that ever worked.
+typedef struct {
+    int cooks;         // working now
+    int peak;          // most working at once
+    uint64_t started;  // cooks started, counting the first min_cooks
+    uint64_t retired;  // cooks that went home idle before the orders ran out
+    uint64_t orders;
+} CookPoolStats;
+
+typedef struct CookPool CookPool;
+
+/**
+ * Starts opts->min_cooks cooks on bcb's orders. For QUEUE_SHARDED, open
+ * the restaurant with num_shards equal to max_cooks: the first cooks
+ * started each own a shard, later ones (replacing retired cooks) only
+ * steal.
+ * Returns NULL if the options are invalid or no cook could start.
+ */
+CookPool *OpenCookPool(BENSCHILLIBOWL* bcb, const CookPoolOptions* opts);
+
+/**
+ * Waits until every cook has left, i.e. every order the restaurant
+ * expects has been handled. Safe to call more than once.
+ */
+void WaitCookPool(CookPool* pool);
+
+/**
+ * Waits for the cooks (see WaitCookPool) and frees the pool. Call it
+ * before CloseRestaurant.
+ */
+void CloseCookPool(CookPool* pool);
+
+/**
+ * Returns the pool's totals so far; may run while the cooks work.
+ */
+CookPoolStats GetCookPoolStats(CookPool* pool);
+
+/**
+ * Prints the totals on one line: cooks started and retired, the peak, and
+ * orders per cook started.
+ */
+void PrintCookPoolStats(CookPool* pool, FILE* f);
+
+#endif  // LAB3_COOKPOOL_H_
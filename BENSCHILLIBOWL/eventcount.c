@@ -0,0 +1,20 @@
+#define _GNU_SOURCE
+#include "eventcount.h"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+void FutexWait(atomic_uint *addr, unsigned val) {
+    syscall(SYS_futex, (void*)addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+void FutexWaitFor(atomic_uint *addr, unsigned val, uint64_t timeout_ns) {
+    struct timespec ts = { (time_t)(timeout_ns / 1000000000ull), (long)(timeout_ns % 1000000000ull) };
+    syscall(SYS_futex, (void*)addr, FUTEX_WAIT_PRIVATE, val, &ts, NULL, 0);
+}
+
+void FutexWake(atomic_uint *addr, int n) {
+    syscall(SYS_futex, (void*)addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
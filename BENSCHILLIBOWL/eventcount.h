@@ -0,0 +1,66 @@
+#ifndef LAB3_EVENTCOUNT_H_
+#define LAB3_EVENTCOUNT_H_
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+// An eventcount lets lock-free code sleep until "something changed" without
+// holding a mutex. A waiter does:
+//
+//     unsigned key = EventCountPrepare(&ec);
+//     if (condition now holds) { EventCountCancel(&ec); ... }
+//     else EventCountWait(&ec, key);
+//
+// and whoever makes the condition true calls EventCountNotify() afterwards.
+// The notifier only touches the futex when someone is actually waiting.
+typedef struct {
+    atomic_uint epoch;
+    atomic_int waiters;
+} EventCount;
+
+// Sleep while *addr == val / wake up to n sleepers on addr (process-private).
+// FutexWaitFor gives up after timeout_ns.
+void FutexWait(atomic_uint *addr, unsigned val);
+void FutexWaitFor(atomic_uint *addr, unsigned val, uint64_t timeout_ns);
+void FutexWake(atomic_uint *addr, int n);
+
+static inline void EventCountInit(EventCount *ec) {
+    atomic_init(&ec->epoch, 0);
+    atomic_init(&ec->waiters, 0);
+}
+
+/* announce ourselves before re-checking the condition */
+static inline unsigned EventCountPrepare(EventCount *ec) {
+    atomic_fetch_add(&ec->waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load(&ec->epoch);
+}
+
+/* condition became true while preparing; don't sleep */
+static inline void EventCountCancel(EventCount *ec) {
+    atomic_fetch_sub(&ec->waiters, 1);
+}
+
+/* sleep unless a notify happened since EventCountPrepare() */
+static inline void EventCountWait(EventCount *ec, unsigned key) {
+    FutexWait(&ec->epoch, key);
+    atomic_fetch_sub(&ec->waiters, 1);
+}
+
+/* same, but wake up after timeout_ns even if nothing was notified */
+static inline void EventCountWaitFor(EventCount *ec, unsigned key, uint64_t timeout_ns) {
+    FutexWaitFor(&ec->epoch, key, timeout_ns);
+    atomic_fetch_sub(&ec->waiters, 1);
+}
+
+/* wake up to n waiters (INT_MAX for all); cheap when nobody waits */
+static inline void EventCountNotify(EventCount *ec, int n) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ec->waiters, memory_order_relaxed) > 0) {
+        atomic_fetch_add(&ec->epoch, 1);
+        FutexWake(&ec->epoch, n);
+    }
+}
+
+#endif  // LAB3_EVENTCOUNT_H_
@@ -0,0 +1,455 @@
+#define _POSIX_C_SOURCE 200809L
+#include "kitchen.h"
+#include "restaurant_internal.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Most orders a cook takes at once (StageSpec.batch).
+#define KITCHEN_MAX_BATCH 64
+
+// The bounded queue in front of every stage after the first: a ring of
+// order pointers under a mutex, like QUEUE_MUTEX. producers counts the
+// previous stage's cooks that are still working; at 0 the queue is
+// closed and takers leave once it is empty.
+typedef struct {
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    Order **ring;
+    int capacity;
+    int head;
+    int size;
+    int producers;
+    int waiting_takers;
+    int waiting_putters;
+} StageQueue;
+
+// One cook. Only the cook itself writes its counters (see StatAdd), so
+// GetKitchenStats can read them while it works. Only the last stage's
+// cooks keep a latency histogram.
+typedef struct {
+    _Alignas(CACHE_LINE) uint64_t orders;
+    uint64_t batches;
+    uint64_t busy_ns;
+    uint64_t starved_ns;
+    uint64_t blocked_ns;
+    uint64_t depth_sum;
+    uint64_t depth_max;
+    Histogram *latency;
+    struct Kitchen *kitchen;
+    int stage;
+    bool started;
+    pthread_t thread;
+} StageCook;
+
+typedef struct {
+    StageSpec spec;
+    StageQueue queue;  // unused by the first stage
+    StageCook *cooks;
+} Stage;
+
+// Cooks wait at the start gate until OpenKitchen has started all of them
+// (KITCHEN_GO), so if one fails to start the rest can be sent home
+// (KITCHEN_ABORT) before they touch an order.
+enum { KITCHEN_STARTING, KITCHEN_GO, KITCHEN_ABORT };
+
+struct Kitchen {
+    BENSCHILLIBOWL *bcb;
+    int num_stages;
+    Stage stages[KITCHEN_MAX_STAGES];
+    pthread_mutex_t start_mutex;
+    pthread_cond_t start_cond;
+    int start;
+    uint64_t opened_at;
+    uint64_t closed_at;  // set once WaitKitchen has joined everyone
+    bool joined;
+};
+
+/* ----- stage queues ----- */
+static bool StageQueueInit(StageQueue *q, int capacity, int producers) {
+    q->ring = (Order**)calloc(capacity, sizeof(Order*));
+    if (!q->ring) return false;
+    q->capacity = capacity;
+    q->head = 0;
+    q->size = 0;
+    q->producers = producers;
+    q->waiting_takers = 0;
+    q->waiting_putters = 0;
+    pthread_mutex_init(&q->mutex, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return true;
+}
+
+static void StageQueueDestroy(StageQueue *q) {
+    if (!q->ring) return;
+    pthread_mutex_destroy(&q->mutex);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+    free(q->ring);
+    q->ring = NULL;
+}
+
+/* append orders[0..n-1], as many per lock hold as fit, waiting for room */
+static void StagePut(StageQueue *q, Order **orders, int n) {
+    pthread_mutex_lock(&q->mutex);
+    int put = 0;
+    while (put < n) {
+        while (q->size == q->capacity) {
+            q->waiting_putters++;
+            pthread_cond_wait(&q->not_full, &q->mutex);
+            q->waiting_putters--;
+        }
+        int room = q->capacity - q->size;
+        int batch = (n - put < room) ? n - put : room;
+        for (int i = 0; i < batch; i++) {
+            q->ring[(q->head + q->size) % q->capacity] = orders[put + i];
+            q->size++;
+        }
+        put += batch;
+        WakeWaiters(&q->not_empty, q->waiting_takers, batch);
+    }
+    pthread_mutex_unlock(&q->mutex);
+}
+
+/* take up to max orders; 0 once the queue is closed and empty.
+   *depth is how many were queued when we took ours. */
+static int StageTake(StageQueue *q, Order **out, int max, int *depth) {
+    pthread_mutex_lock(&q->mutex);
+    while (q->size == 0 && q->producers > 0) {
+        q->waiting_takers++;
+        pthread_cond_wait(&q->not_empty, &q->mutex);
+        q->waiting_takers--;
+    }
+
+    *depth = q->size;
+    int taken = (max < q->size) ? max : q->size;
+    for (int i = 0; i < taken; i++) {
+        out[i] = q->ring[q->head];
+        q->ring[q->head] = NULL;
+        q->head = (q->head + 1) % q->capacity;
+        q->size--;
+    }
+
+    if (taken > 0) {
+        WakeWaiters(&q->not_full, q->waiting_putters, taken);
+    } else if (q->waiting_takers > 0) {
+        pthread_cond_signal(&q->not_empty);  // closed: pass the news on
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return taken;
+}
+
+/* one of the queue's producers has left; the last one closes it */
+static void StageQueueProducerDone(StageQueue *q) {
+    pthread_mutex_lock(&q->mutex);
+    if (--q->producers == 0) pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->mutex);
+}
+
+/* ----- cooks ----- */
+/* false if the kitchen failed to open and the cook should leave at once */
+static bool WaitForStart(Kitchen *k) {
+    pthread_mutex_lock(&k->start_mutex);
+    while (k->start == KITCHEN_STARTING) pthread_cond_wait(&k->start_cond, &k->start_mutex);
+    bool go = k->start == KITCHEN_GO;
+    pthread_mutex_unlock(&k->start_mutex);
+    return go;
+}
+
+static void *StageCookMain(void *arg) {
+    StageCook *c = (StageCook*)arg;
+    Kitchen *k = c->kitchen;
+    if (!WaitForStart(k)) return NULL;
+    Stage *stage = &k->stages[c->stage];
+    Stage *next = (c->stage + 1 < k->num_stages) ? &k->stages[c->stage + 1] : NULL;
+    int batch = stage->spec.batch > 0 ? stage->spec.batch : 1;
+    Order *ords[KITCHEN_MAX_BATCH];
+
+    uint64_t waited_from = NowNs();
+    for (;;) {
+        int depth;
+        int n;
+        if (c->stage == 0) {
+            n = GetOrdersLeft(k->bcb, ords, batch, &depth);
+            depth += n;
+        } else {
+            n = StageTake(&stage->queue, ords, batch, &depth);
+        }
+        uint64_t took_at = NowNs();
+        StatAdd(&c->starved_ns, took_at - waited_from);
+        if (n == 0) break;
+
+        if (stage->spec.work) {
+            for (int i = 0; i < n; i++) stage->spec.work(ords[i], stage->spec.arg);
+        }
+        uint64_t done_at = NowNs();
+        StatAdd(&c->busy_ns, done_at - took_at);
+        StatAdd(&c->orders, (uint64_t)n);
+        StatAdd(&c->batches, 1);
+        StatAdd(&c->depth_sum, (uint64_t)depth);
+        if ((uint64_t)depth > c->depth_max) __atomic_store_n(&c->depth_max, (uint64_t)depth, __ATOMIC_RELAXED);
+
+        if (next) {
+            /* blocks while the next stage is full: that's the backpressure */
+            StagePut(&next->queue, ords, n);
+            waited_from = NowNs();
+            StatAdd(&c->blocked_ns, waited_from - done_at);
+        } else {
+            for (int i = 0; i < n; i++) {
+                if (c->latency && ords[i]->enqueued_at) {
+                    HistogramRecord(c->latency, done_at - ords[i]->enqueued_at);
+                }
+                if (stage->spec.complete) CompleteOrder(k->bcb, ords[i]);
+                else ReleaseOrder(k->bcb, ords[i]);
+            }
+            waited_from = NowNs();
+        }
+    }
+
+    if (next) StageQueueProducerDone(&next->queue);
+    return NULL;
+}
+
+/* ----- kitchen ----- */
+static bool ValidStage(const StageSpec *spec) {
+    return spec->cooks > 0 && spec->queue_size >= 0 &&
+           spec->batch >= 0 && spec->batch <= KITCHEN_MAX_BATCH;
+}
+
+static void FreeKitchen(Kitchen *k) {
+    for (int s = 0; s < k->num_stages; s++) {
+        Stage *stage = &k->stages[s];
+        for (int i = 0; stage->cooks && i < stage->spec.cooks; i++) {
+            free(stage->cooks[i].latency);
+        }
+        free(stage->cooks);
+        StageQueueDestroy(&stage->queue);
+    }
+    pthread_cond_destroy(&k->start_cond);
+    pthread_mutex_destroy(&k->start_mutex);
+    free(k);
+}
+
+Kitchen *OpenKitchen(BENSCHILLIBOWL* bcb, const StageSpec* stages, int num_stages) {
+    if (num_stages <= 0 || num_stages > KITCHEN_MAX_STAGES) return NULL;
+    for (int s = 0; s < num_stages; s++) {
+        if (!ValidStage(&stages[s])) return NULL;
+    }
+
+    /* the queues are cache-line aligned, which calloc doesn't guarantee */
+    Kitchen *k = (Kitchen*)aligned_alloc(_Alignof(Kitchen), sizeof(Kitchen));
+    if (!k) return NULL;
+    memset(k, 0, sizeof(*k));
+    k->bcb = bcb;
+    k->num_stages = num_stages;
+    pthread_mutex_init(&k->start_mutex, NULL);
+    pthread_cond_init(&k->start_cond, NULL);
+    k->start = KITCHEN_STARTING;
+
+    /* allocate everything before the first cook starts */
+    for (int s = 0; s < num_stages; s++) {
+        Stage *stage = &k->stages[s];
+        stage->spec = stages[s];
+        stage->spec.name[STAGE_NAME_LEN - 1] = '\0';
+        if (stage->spec.queue_size == 0) stage->spec.queue_size = KITCHEN_DEFAULT_QUEUE;
+
+        int cooks = stage->spec.cooks;
+        stage->cooks = (StageCook*)aligned_alloc(_Alignof(StageCook), cooks * sizeof(StageCook));
+        if (!stage->cooks) {
+            FreeKitchen(k);
+            return NULL;
+        }
+        /* before anything can fail: FreeKitchen frees every latency */
+        memset(stage->cooks, 0, cooks * sizeof(StageCook));
+        if (s > 0 && !StageQueueInit(&stage->queue, stage->spec.queue_size, stages[s - 1].cooks)) {
+            FreeKitchen(k);
+            return NULL;
+        }
+        for (int i = 0; i < cooks; i++) {
+            stage->cooks[i].kitchen = k;
+            stage->cooks[i].stage = s;
+            if (s == num_stages - 1) {
+                stage->cooks[i].latency = (Histogram*)malloc(sizeof(Histogram));
+                if (!stage->cooks[i].latency) {
+                    FreeKitchen(k);
+                    return NULL;
+                }
+                HistogramReset(stage->cooks[i].latency);
+            }
+        }
+    }
+
+    /* every cook or none: a stage short of a cook could stall the rest */
+    bool all_started = true;
+    for (int s = 0; s < num_stages && all_started; s++) {
+        Stage *stage = &k->stages[s];
+        for (int i = 0; i < stage->spec.cooks && all_started; i++) {
+            StageCook *c = &stage->cooks[i];
+            c->started = pthread_create(&c->thread, NULL, StageCookMain, c) == 0;
+            all_started = c->started;
+        }
+    }
+
+    k->opened_at = NowNs();
+    pthread_mutex_lock(&k->start_mutex);
+    k->start = all_started ? KITCHEN_GO : KITCHEN_ABORT;
+    pthread_cond_broadcast(&k->start_cond);
+    pthread_mutex_unlock(&k->start_mutex);
+    if (!all_started) {
+        WaitKitchen(k);
+        FreeKitchen(k);
+        return NULL;
+    }
+    return k;
+}
+
+void WaitKitchen(Kitchen* k) {
+    if (k->joined) return;
+    for (int s = 0; s < k->num_stages; s++) {
+        Stage *stage = &k->stages[s];
+        for (int i = 0; i < stage->spec.cooks; i++) {
+            if (stage->cooks[i].started) pthread_join(stage->cooks[i].thread, NULL);
+        }
+    }
+    k->closed_at = NowNs();
+    k->joined = true;
+}
+
+void CloseKitchen(Kitchen* k) {
+    WaitKitchen(k);
+    FreeKitchen(k);
+}
+
+int GetKitchenStats(Kitchen* k, StageStats* out) {
+    uint64_t elapsed = (k->joined ? k->closed_at : NowNs()) - k->opened_at;
+    for (int s = 0; s < k->num_stages; s++) {
+        Stage *stage = &k->stages[s];
+        StageStats *st = &out[s];
+        memset(st, 0, sizeof(*st));
+        memcpy(st->name, stage->spec.name, STAGE_NAME_LEN);
+        st->cooks = stage->spec.cooks;
+        st->queue_size = s == 0 ? k->bcb->max_size : stage->spec.queue_size;
+
+        for (int i = 0; i < stage->spec.cooks; i++) {
+            const StageCook *c = &stage->cooks[i];
+            st->orders += StatLoad(&c->orders);
+            st->batches += StatLoad(&c->batches);
+            st->busy_ns += StatLoad(&c->busy_ns);
+            st->starved_ns += StatLoad(&c->starved_ns);
+            st->blocked_ns += StatLoad(&c->blocked_ns);
+            st->depth_sum += StatLoad(&c->depth_sum);
+            uint64_t depth_max = StatLoad(&c->depth_max);
+            if (depth_max > (uint64_t)st->depth_max) st->depth_max = (int)depth_max;
+        }
+        st->utilization = elapsed ? (double)st->busy_ns / ((double)st->cooks * elapsed) : 0.0;
+    }
+    return k->num_stages;
+}
+
+void GetKitchenLatency(Kitchen* k, Histogram* out) {
+    Stage *last = &k->stages[k->num_stages - 1];
+    for (int i = 0; i < last->spec.cooks; i++) {
+        HistogramMerge(out, last->cooks[i].latency);
+    }
+}
+
+void PrintKitchenStats(Kitchen* k, FILE* f) {
+    StageStats st[KITCHEN_MAX_STAGES];
+    int n = GetKitchenStats(k, st);
+    uint64_t elapsed = (k->joined ? k->closed_at : NowNs()) - k->opened_at;
+
+    int bottleneck = 0;
+    for (int s = 1; s < n; s++) {
+        if (st[s].utilization > st[bottleneck].utilization) bottleneck = s;
+    }
+
+    fprintf(f, "Kitchen: %d stage(s), %.3f ms\n", n, elapsed / 1e6);
+    fprintf(f, "  %-15s %5s %8s %6s %8s %8s %11s\n",
+            "stage", "cooks", "orders", "util", "starved", "blocked", "queue");
+    for (int s = 0; s < n; s++) {
+        double cook_ns = (double)st[s].cooks * (elapsed ? elapsed : 1);
+        double mean_depth = st[s].batches ? (double)st[s].depth_sum / st[s].batches : 0.0;
+        fprintf(f, "  %-15s %5d %8llu %5.1f%% %7.1f%% %7.1f%% %5.1f/%-5d%s\n",
+                st[s].name, st[s].cooks, (unsigned long long)st[s].orders,
+                100.0 * st[s].utilization, 100.0 * st[s].starved_ns / cook_ns,
+                100.0 * st[s].blocked_ns / cook_ns, mean_depth, st[s].queue_size,
+                s == bottleneck && n > 1 ? "  <- bottleneck" : "");
+    }
+}
+
+/* ----- service times ----- */
+void ServeOrder(Order* order, void* service_time) {
+    (void)order;
+    const ServiceTime *t = (const ServiceTime*)service_time;
+    uint64_t us = t->lo_us;
+    if (t->hi_us > t->lo_us) us += RngBelow(ThreadRandom(), t->hi_us - t->lo_us + 1);
+    if (us == 0) return;
+
+    if (t->spin) {
+        uint64_t until = NowNs() + us * 1000;
+        while (NowNs() < until) {
+        }
+    } else {
+        struct timespec ts = { (time_t)(us / 1000000), (long)(us % 1000000) * 1000 };
+        nanosleep(&ts, NULL);
+    }
+}
+
+/* "name:cooks:us[-us][:queue]" */
+static bool ParseStage(char *tok, StageSpec *stage, ServiceTime *time, bool spin) {
+    char *fields[4];
+    int n = 0;
+    char *save;
+    for (char *f = strtok_r(tok, ":", &save); f; f = strtok_r(NULL, ":", &save)) {
+        if (n == 4) return false;
+        fields[n++] = f;
+    }
+    if (n < 3 || strlen(fields[0]) >= STAGE_NAME_LEN) return false;
+
+    char *end;
+    long cooks = strtol(fields[1], &end, 10);
+    if (*end || cooks <= 0 || cooks > 4096) return false;
+
+    unsigned long lo = strtoul(fields[2], &end, 10), hi = lo;
+    if (end == fields[2]) return false;
+    if (*end == '-') hi = strtoul(end + 1, &end, 10);
+    if (*end || hi < lo || hi > UINT32_MAX) return false;
+
+    long queue = 0;
+    if (n == 4) {
+        queue = strtol(fields[3], &end, 10);
+        if (*end || queue <= 0 || queue > 1 << 20) return false;
+    }
+
+    memset(stage, 0, sizeof(*stage));
+    strcpy(stage->name, fields[0]);
+    stage->cooks = (int)cooks;
+    stage->queue_size = (int)queue;
+    stage->work = ServeOrder;
+    stage->arg = time;
+    time->lo_us = (uint32_t)lo;
+    time->hi_us = (uint32_t)hi;
+    time->spin = spin;
+    return true;
+}
+
+int ParseKitchen(const char* spec, StageSpec* stages, ServiceTime* times,
+                 int max_stages, bool spin) {
+    char *copy = strdup(spec);
+    if (!copy) return -1;
+
+    int n = 0;
+    char *save;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if (n == max_stages || !ParseStage(tok, &stages[n], &times[n], spin)) {
+            n = -1;
+            break;
+        }
+        n++;
+    }
+    free(copy);
+    return n > 0 ? n : -1;
+}
@@ -0,0 +1,127 @@
+#ifndef LAB3_KITCHEN_H_
+#define LAB3_KITCHEN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "BENSCHILLIBOWL.h"
+#include "histogram.h"
+
+// A kitchen runs a restaurant's orders through a pipeline of stages, e.g.
+// prep -> grill -> assemble. Each stage has its own cooks and its own
+// bounded queue in front of it; the first stage's queue is the
+// restaurant's (any QueueMode), so customers still just call AddOrder(s).
+//
+//  - An Order moves between stages as the same pointer: nothing is copied
+//    or allocated on the way, and the last stage releases it to the pool
+//    (or completes it, for customers that wait on their orders).
+//  - A cook that finds the next queue full waits for room, so it stops
+//    taking orders, its own queue fills, and so on back to AddOrder:
+//    backpressure needs no extra machinery.
+//  - When the restaurant runs out of orders the first stage's cooks leave;
+//    the last cook out of each stage closes the next stage's queue, whose
+//    cooks drain it and leave in turn.
+//  - Every cook keeps its own counters (busy, starved, blocked, queue
+//    depth) on its own cache line; GetKitchenStats sums them per stage.
+#define KITCHEN_MAX_STAGES 8
+#define KITCHEN_DEFAULT_QUEUE 16
+#define STAGE_NAME_LEN 16
+
+// What a cook does to one order at its stage (arg is StageSpec.arg).
+typedef void (*StageWork)(Order* order, void* arg);
+
+typedef struct {
+    char name[STAGE_NAME_LEN];  // e.g. "grill"
+    int cooks;                  // threads working this stage (> 0)
+    int queue_size;             // bound on the queue in front of it (0 = KITCHEN_DEFAULT_QUEUE);
+                                // ignored for the first stage, which uses the restaurant's
+    int batch;                  // orders a cook takes and passes on at once (0 = 1, max 64)
+    StageWork work;             // NULL = the stage only hands orders on
+    void *arg;
+    bool complete;              // last stage only: hand orders back with CompleteOrder
+                                // (their customers wait for them) instead of releasing them
+} StageSpec;
+
+// A service time for ServeOrder: uniform in [lo_us, hi_us], spent either
+// sleeping or (spin) busy-waiting, which keeps short times accurate.
+typedef struct {
+    uint32_t lo_us;
+    uint32_t hi_us;
+    bool spin;
+} ServiceTime;
+
+// Per-stage totals, summed over the stage's cooks. Times are ns.
+typedef struct {
+    char name[STAGE_NAME_LEN];
+    int cooks;
+    int queue_size;       // the bound on the stage's queue (the restaurant's max_size for stage 0)
+    uint64_t orders;      // orders through the stage
+    uint64_t batches;     // times a cook took orders
+    uint64_t busy_ns;     // in StageSpec.work
+    uint64_t starved_ns;  // waiting for orders
+    uint64_t blocked_ns;  // waiting for room in the next stage's queue
+    uint64_t depth_sum;   // orders queued in front of the stage at each take, summed
+    int depth_max;
+    double utilization;   // busy_ns / (cooks * time the kitchen has been open)
+} StageStats;
+
+typedef struct Kitchen Kitchen;
+
+/**
+ * Starts the cooks of every stage on bcb's orders. stages[0] takes from
+ * the restaurant; stages[i] from a queue of stages[i].queue_size fed by
+ * stages[i - 1]. For QUEUE_SHARDED, open the restaurant with num_shards
+ * equal to stages[0].cooks.
+ * Returns NULL if the spec is invalid or anything fails to start; then
+ * no cook has taken an order, and bcb can be discarded.
+ */
+Kitchen *OpenKitchen(BENSCHILLIBOWL* bcb, const StageSpec* stages, int num_stages);
+
+/**
+ * Waits until every cook has left, i.e. every order the restaurant
+ * expects has been through every stage. Safe to call more than once.
+ */
+void WaitKitchen(Kitchen* k);
+
+/**
+ * Waits for the cooks (see WaitKitchen) and frees the kitchen. Call it
+ * before CloseRestaurant: the last stage may still be releasing orders.
+ */
+void CloseKitchen(Kitchen* k);
+
+/**
+ * Fills out[0..num_stages-1] with each stage's totals so far; may run
+ * while the kitchen is busy. Returns the number of stages.
+ */
+int GetKitchenStats(Kitchen* k, StageStats* out);
+
+/**
+ * Merges into out how long each order that had enqueued_at set took from
+ * then until it left the last stage. Only valid after WaitKitchen.
+ */
+void GetKitchenLatency(Kitchen* k, Histogram* out);
+
+/**
+ * Prints one line per stage: utilization, where its cooks' time went and
+ * the depth of its queue. The bottleneck is the busiest stage; the
+ * stages before it show up blocked, with full queues.
+ */
+void PrintKitchenStats(Kitchen* k, FILE* f);
+
+/**
+ * A StageWork that spends a ServiceTime (arg) on the order.
+ */
+void ServeOrder(Order* order, void* service_time);
+
+/**
+ * Parses "name:cooks:us[-us][:queue],..." (e.g.
+ * "prep:2:100,grill:4:300-500,assemble:1:50:8") into stages that run
+ * ServeOrder on times[i]; spin picks busy-waiting over sleeping.
+ * Returns the number of stages, or -1 if spec is malformed or longer
+ * than max_stages.
+ */
+int ParseKitchen(const char* spec, StageSpec* stages, ServiceTime* times,
+                 int max_stages, bool spin);
+
+#endif  // LAB3_KITCHEN_H_
@@ -3,63 +3,91 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "BENSCHILLIBOWL.h"
+#include "kitchen.h"
+#include "cookpool.h"
+#include "restaurant_internal.h"
 
 // Tunables for testing
 #define BENSCHILLIBOWL_SIZE 100
 #define NUM_CUSTOMERS 90
 #define NUM_COOKS 10
 #define ORDERS_PER_CUSTOMER 3
+#define COOK_BATCH 4
 #define EXPECTED_NUM_ORDERS (NUM_CUSTOMERS * ORDERS_PER_CUSTOMER)
 
 // Global restaurant
 BENSCHILLIBOWL *bcb;
 
+// How long each customer waited for its food, in ns (customer i at i - 1)
+uint64_t waited_ns[NUM_CUSTOMERS];
+
 /**
  * Customer thread:
- *  - allocate an Order
- *  - pick a menu item
- *  - set fields (item, customer_id)
- *  - add to restaurant
+ *  - acquire its Orders from the restaurant
+ *  - pick a menu item for each
+ *  - set fields (item, customer_id, priority)
+ *  - add them to the restaurant in one batch
+ *  - wait until all of them are fulfilled, then release them
  */
 void* BENSCHILLIBOWLCustomer(void* tid) {
     int customer_id = (int)(long)tid;
+    Order *ords[ORDERS_PER_CUSTOMER];
+    SeedThreadRandom((uint64_t)customer_id);  // same picks on every run with one --seed
 
     for (int i = 0; i < ORDERS_PER_CUSTOMER; i++) {
-        Order *ord = (Order*)malloc(sizeof(Order));
+        Order *ord = AcquireOrder(bcb);
+        if (!ord) {
+            /* the cooks would wait forever for the orders we can't place */
+            fprintf(stderr, "customer %d: out of memory for orders\n", customer_id);
+            exit(1);
+        }
         ord->menu_item   = PickRandomMenuItem();
         ord->customer_id = customer_id;
+        ord->priority    = (uint8_t)(customer_id % ORDER_PRIORITY_LEVELS);
         ord->order_number = 0;
         ord->next = NULL;
+        ords[i] = ord;
+    }
 
-        int onum = AddOrder(bcb, ord);
-        (void)onum; // number assigned; not required to print
+    /* tiny think-time to increase interleaving */
+    usleep(1000 * RngBelow(ThreadRandom(), 10));
 
-        /* tiny think-time to increase interleaving */
-        usleep(1000 * (rand() % 10));
+    uint64_t start = NowNs();
+    int first = AddOrders(bcb, ords, ORDERS_PER_CUSTOMER);
+    (void)first; // numbers assigned; not required to print
+
+    WaitOrders(ords, ORDERS_PER_CUSTOMER);
+    waited_ns[customer_id - 1] = NowNs() - start;
+    for (int i = 0; i < ORDERS_PER_CUSTOMER; i++) {
+        ReleaseOrder(bcb, ords[i]);
     }
     return NULL;
 }
 
 /**
  * Cook thread:
- *  - keep getting orders until GetOrder returns NULL
- *  - "fulfill" then free the order
+ *  - keep getting batches of orders until GetOrders returns 0
+ *  - "fulfill" the orders and hand them back to their customers
  */
 void* BENSCHILLIBOWLCook(void* tid) {
     int cook_id = (int)(long)tid;
     int orders_fulfilled = 0;
+    Order *ords[COOK_BATCH];
 
     for (;;) {
-        Order *ord = GetOrder(bcb);
-        if (ord == NULL) break;               // no more work
+        int n = GetOrders(bcb, ords, COOK_BATCH);
+        if (n == 0) break;                    // no more work
 
-        // Simulate cooking (optional)
-        // usleep(1000 * (rand() % 20));
+        for (int i = 0; i < n; i++) {
+            // Simulate cooking (optional)
+            // usleep(1000 * (rand() % 20));
 
-        free(ord);
-        orders_fulfilled++;
+            CompleteOrder(bcb, ords[i]);
+            orders_fulfilled++;
+        }
     }
 
     printf("Cook #%d fulfilled %d orders\n", cook_id, orders_fulfilled);
@@ -68,35 +96,119 @@ void* BENSCHILLIBOWLCook(void* tid) {
 
 /**
  * Program entry:
+ *  - pick the queue backend (optional argv[1]: mutex | lockfree | sharded |
+ *    priority | coalesce) and wait policy (optional argv[2]: park | spin), and
+ *    optionally fix the random seed (--seed N, anywhere)
  *  - open restaurant
- *  - start customers and cooks
- *  - join all threads
- *  - close restaurant
+ *  - start customers and cooks; with --pipeline SPEC the cooks are the
+ *    stages of a kitchen instead (see ParseKitchen), e.g.
+ *    --pipeline prep:3:200,grill:5:500-1500,assemble:2:300; with --elastic
+ *    MIN-MAX they are a pool that grows and shrinks between MIN and MAX
+ *    cooks with the queue (see cookpool.h)
+ *  - join all threads, and report how long customers waited for their food
+ *  - close restaurant (and kitchen or pool, printing where its time went)
  */
-int main() {
-    bcb = OpenRestaurant(BENSCHILLIBOWL_SIZE, EXPECTED_NUM_ORDERS);
+int main(int argc, char **argv) {
+    RestaurantOptions opts = {0};
+    opts.num_shards = NUM_COOKS;
+    opts.collect_stats = true;  // only takes effect in a make STATS=1 build
+    StageSpec stages[KITCHEN_MAX_STAGES];
+    ServiceTime times[KITCHEN_MAX_STAGES];
+    int num_stages = 0;
+    CookPoolOptions pool_opts = {0};
+    const char *args[2] = { NULL, NULL };
+    int nargs = 0;
+    bool bad = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) SeedRandom(strtoull(argv[++i], NULL, 0));
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            num_stages = ParseKitchen(argv[++i], stages, times, KITCHEN_MAX_STAGES, false);
+            bad |= num_stages < 0;
+        }
+        else if (strcmp(argv[i], "--elastic") == 0 && i + 1 < argc) {
+            bad |= sscanf(argv[++i], "%d-%d", &pool_opts.min_cooks, &pool_opts.max_cooks) != 2 ||
+                   pool_opts.min_cooks <= 0 || pool_opts.max_cooks < pool_opts.min_cooks;
+        }
+        else if (nargs < 2) args[nargs++] = argv[i];
+        else bad = true;
+    }
+    bad |= num_stages > 0 && pool_opts.min_cooks > 0;
+    if (bad || (args[0] && !QueueModeFromName(args[0], &opts.queue_mode)) ||
+        (args[1] && !WaitPolicyFromName(args[1], &opts.wait_policy))) {
+        fprintf(stderr, "Usage: %s [mutex|lockfree|sharded|priority|coalesce] [park|spin] [--seed N]\n"
+                        "       [--pipeline name:cooks:us[-us][:queue],... | --elastic MIN-MAX]\n",
+                argv[0]);
+        return 1;
+    }
+    if (num_stages > 0) {
+        opts.num_shards = stages[0].cooks;
+        stages[num_stages - 1].complete = true;  // the customers wait for their food
+    }
+    if (pool_opts.min_cooks > 0) {
+        opts.num_shards = pool_opts.max_cooks;
+        pool_opts.batch = COOK_BATCH;
+        pool_opts.complete = true;
+    }
+
+    bcb = OpenRestaurantWithOptions(BENSCHILLIBOWL_SIZE, EXPECTED_NUM_ORDERS, &opts);
 
     pthread_t customers[NUM_CUSTOMERS];
     pthread_t cooks[NUM_COOKS];
+    Kitchen *kitchen = NULL;
+    CookPool *pool = NULL;
 
     // spawn cooks first or customers first—either works
-    for (int i = 0; i < NUM_COOKS; i++) {
+    if (num_stages > 0) {
+        kitchen = OpenKitchen(bcb, stages, num_stages);
+        if (!kitchen) {
+            fprintf(stderr, "could not open the kitchen\n");
+            DiscardRestaurant(bcb);
+            return 1;
+        }
+    }
+    if (pool_opts.min_cooks > 0) {
+        pool = OpenCookPool(bcb, &pool_opts);
+        if (!pool) {
+            fprintf(stderr, "could not start the cook pool\n");
+            DiscardRestaurant(bcb);
+            return 1;
+        }
+    }
+    for (int i = 0; !kitchen && !pool && i < NUM_COOKS; i++) {
         pthread_create(&cooks[i], NULL, BENSCHILLIBOWLCook, (void*)(long)(i+1));
     }
     for (int i = 0; i < NUM_CUSTOMERS; i++) {
         pthread_create(&customers[i], NULL, BENSCHILLIBOWLCustomer, (void*)(long)(i+1));
     }
 
-    // wait for customers to finish adding orders
+    // wait for customers to get all their food
     for (int i = 0; i < NUM_CUSTOMERS; i++) {
         pthread_join(customers[i], NULL);
     }
 
     // wait for cooks to finish consuming all orders
-    for (int i = 0; i < NUM_COOKS; i++) {
+    if (kitchen) {
+        WaitKitchen(kitchen);
+        PrintKitchenStats(kitchen, stdout);
+        CloseKitchen(kitchen);
+    }
+    if (pool) {
+        WaitCookPool(pool);
+        PrintCookPoolStats(pool, stdout);
+        CloseCookPool(pool);
+    }
+    for (int i = 0; !kitchen && !pool && i < NUM_COOKS; i++) {
         pthread_join(cooks[i], NULL);
     }
 
+    uint64_t total = 0, longest = 0;
+    for (int i = 0; i < NUM_CUSTOMERS; i++) {
+        total += waited_ns[i];
+        if (waited_ns[i] > longest) longest = waited_ns[i];
+    }
+    printf("Customers waited %.3f ms on average (longest %.3f ms) for their food\n",
+           total / 1e6 / NUM_CUSTOMERS, longest / 1e6);
+
     CloseRestaurant(bcb);
     return 0;
 }
@@ -0,0 +1,216 @@
+#include "BENSCHILLIBOWL.h"
+#include "orderpool.h"
+
+#include <stdlib.h>
+
+// How many orders a thread moves between its cache and the pool at once.
+#define POOL_BATCH 16
+
+struct OrderSlab {
+    struct OrderSlab *next;
+    int count;
+    Order orders[];
+};
+
+// Per-thread cache. pool and pool_id say which pool the cached orders
+// belong to; a thread that starts using another pool, or exits, gives
+// them back to it first (FlushCache).
+typedef struct {
+    OrderPool *pool;
+    unsigned long pool_id;
+    Order *free;
+    int free_count;
+    Order *released, *released_tail;
+    int released_count;
+} OrderCache;
+
+static _Thread_local OrderCache cache;
+static atomic_ulong next_pool_id = 1;
+
+// Pools not yet destroyed. A cache is only flushed into a pool on this
+// list, and destroying takes a pool off it, under live_pools_lock.
+static pthread_mutex_t live_pools_lock = PTHREAD_MUTEX_INITIALIZER;
+static OrderPool *live_pools;
+
+// Flushes a thread's cache when the thread exits.
+static pthread_key_t cache_key;
+static pthread_once_t cache_key_once = PTHREAD_ONCE_INIT;
+
+static bool AddSlab(OrderPool *pool, int count);
+static OrderCache *CacheFor(OrderPool *pool);
+static void FlushCache(void *cache);
+static void PushReturned(OrderPool *pool, Order *head, Order *tail);
+static void Refill(OrderPool *pool, OrderCache *c);
+
+bool OrderPoolInit(OrderPool *pool, int capacity) {
+    pool->id          = atomic_fetch_add(&next_pool_id, 1);
+    atomic_init(&pool->returned, NULL);
+    pthread_mutex_init(&pool->depot_lock, NULL);
+    pool->depot       = NULL;
+    pool->depot_count = 0;
+    pool->slabs       = NULL;
+    pool->capacity    = 0;
+
+    if (capacity < POOL_BATCH) capacity = POOL_BATCH;
+    if (!AddSlab(pool, capacity)) {
+        pthread_mutex_destroy(&pool->depot_lock);
+        return false;
+    }
+
+    pthread_mutex_lock(&live_pools_lock);
+    pool->next_live = live_pools;
+    live_pools = pool;
+    pthread_mutex_unlock(&live_pools_lock);
+    return true;
+}
+
+void OrderPoolDestroy(OrderPool *pool) {
+    pthread_mutex_lock(&live_pools_lock);
+    for (OrderPool **p = &live_pools; *p; p = &(*p)->next_live) {
+        if (*p == pool) {
+            *p = pool->next_live;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&live_pools_lock);
+
+    struct OrderSlab *slab = pool->slabs;
+    while (slab) {
+        struct OrderSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    pool->slabs = NULL;
+    pthread_mutex_destroy(&pool->depot_lock);
+}
+
+Order *OrderPoolGet(OrderPool *pool) {
+    OrderCache *c = CacheFor(pool);
+    if (!c->free) {
+        Refill(pool, c);
+        if (!c->free) return NULL;
+    }
+
+    Order *order = c->free;
+    c->free = order->next;
+    c->free_count--;
+    order->next = NULL;
+    return order;
+}
+
+void OrderPoolPut(OrderPool *pool, Order *order) {
+    OrderCache *c = CacheFor(pool);
+
+    order->next = c->released;
+    if (!c->released) c->released_tail = order;
+    c->released = order;
+    if (++c->released_count < POOL_BATCH) return;
+
+    PushReturned(pool, c->released, c->released_tail);
+    c->released = c->released_tail = NULL;
+    c->released_count = 0;
+}
+
+/* ----- helpers ----- */
+static void MakeCacheKey(void) {
+    pthread_key_create(&cache_key, FlushCache);
+}
+
+static OrderCache *CacheFor(OrderPool *pool) {
+    if (cache.pool_id != pool->id) {
+        if (cache.pool_id != 0) {
+            FlushCache(&cache);
+        } else {
+            /* first pool this thread uses: flush again when it exits */
+            pthread_once(&cache_key_once, MakeCacheKey);
+            pthread_setspecific(cache_key, &cache);
+        }
+        cache = (OrderCache){ .pool = pool, .pool_id = pool->id };
+    }
+    return &cache;
+}
+
+/* give a cache's orders back to its pool, unless that is gone, and empty it */
+static void FlushCache(void *arg) {
+    OrderCache *c = (OrderCache*)arg;
+    pthread_mutex_lock(&live_pools_lock);
+    for (OrderPool *pool = live_pools; pool; pool = pool->next_live) {
+        if (pool != c->pool || pool->id != c->pool_id) continue;
+        if (c->released) PushReturned(pool, c->released, c->released_tail);
+        if (c->free) {
+            Order *tail = c->free;
+            while (tail->next) tail = tail->next;
+            PushReturned(pool, c->free, tail);
+        }
+        break;
+    }
+    pthread_mutex_unlock(&live_pools_lock);
+    *c = (OrderCache){ 0 };
+}
+
+/* hand a whole chain back with one CAS; pushes never suffer ABA */
+static void PushReturned(OrderPool *pool, Order *head, Order *tail) {
+    Order *top = atomic_load_explicit(&pool->returned, memory_order_relaxed);
+    do {
+        tail->next = top;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->returned, &top, head,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+/* carve a new slab and put all of its orders in the depot (lock held or init) */
+static bool AddSlab(OrderPool *pool, int count) {
+    /* Orders are cache-line aligned, so the slab must be too */
+    size_t bytes = sizeof(struct OrderSlab) + (size_t)count * sizeof(Order);
+    bytes = (bytes + _Alignof(Order) - 1) / _Alignof(Order) * _Alignof(Order);
+    struct OrderSlab *slab = aligned_alloc(_Alignof(Order), bytes);
+    if (!slab) return false;
+    slab->count = count;
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    for (int i = count - 1; i >= 0; i--) {
+        slab->orders[i].next = pool->depot;
+        pool->depot = &slab->orders[i];
+    }
+    pool->depot_count += count;
+    pool->capacity += count;
+    return true;
+}
+
+/* move a batch of orders from the depot into this thread's cache */
+static void Refill(OrderPool *pool, OrderCache *c) {
+    pthread_mutex_lock(&pool->depot_lock);
+
+    if (pool->depot_count == 0) {
+        /* collect everything other threads have put back */
+        Order *list = atomic_exchange_explicit(&pool->returned, NULL, memory_order_acquire);
+        while (list) {
+            Order *next = list->next;
+            list->next = pool->depot;
+            pool->depot = list;
+            pool->depot_count++;
+            list = next;
+        }
+    }
+    if (pool->depot_count == 0) {
+        /* exhausted: grow by a quarter so this stays rare */
+        int grow = pool->capacity / 4;
+        AddSlab(pool, grow > POOL_BATCH ? grow : POOL_BATCH);
+    }
+
+    /* leave at least half of the depot for other threads */
+    int take = pool->depot_count / 2 + 1;
+    if (take > POOL_BATCH) take = POOL_BATCH;
+    if (take > pool->depot_count) take = pool->depot_count;
+    for (int i = 0; i < take; i++) {
+        Order *order = pool->depot;
+        pool->depot = order->next;
+        order->next = c->free;
+        c->free = order;
+    }
+    pool->depot_count -= take;
+    c->free_count += take;
+
+    pthread_mutex_unlock(&pool->depot_lock);
+}
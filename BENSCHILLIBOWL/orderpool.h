@@ -0,0 +1,58 @@
+#ifndef LAB3_ORDERPOOL_H_
+#define LAB3_ORDERPOOL_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+struct OrderStruct;
+struct OrderSlab;
+
+// A pool of Orders owned by one restaurant. Orders live in slabs that are
+// carved up front and only freed when the pool is destroyed, so getting and
+// putting an order never calls malloc/free once the pool is warm.
+//
+//  - Each thread keeps a small cache of free orders and of orders it has
+//    put back, tagged with the pool's id.
+//  - Full caches of put-back orders are pushed onto `returned`, a lock-free
+//    stack, with a single CAS. This is the cross-thread free path.
+//  - A thread whose cache runs dry refills from the depot under
+//    depot_lock, draining `returned` into the depot first if needed.
+//    Only the depot lock holder ever pops from `returned`.
+//  - A thread that moves on to another pool, or exits, pushes its cache
+//    onto `returned` too, unless the pool has been destroyed meanwhile.
+typedef struct OrderPool {
+    unsigned long id;
+    struct OrderPool *next_live;  // on the list of pools not yet destroyed
+    _Alignas(64) _Atomic(struct OrderStruct*) returned;
+
+    _Alignas(64) pthread_mutex_t depot_lock;
+    struct OrderStruct *depot;
+    int depot_count;
+    struct OrderSlab *slabs;
+    int capacity;
+} OrderPool;
+
+/**
+ * Carves the first slab with room for `capacity` orders.
+ * Returns false if that allocation fails.
+ */
+bool OrderPoolInit(OrderPool *pool, int capacity);
+
+/**
+ * Frees every slab. Orders still held by anyone become invalid.
+ */
+void OrderPoolDestroy(OrderPool *pool);
+
+/**
+ * Takes a free order from the pool, growing it if it is exhausted.
+ * Returns NULL only if growing fails.
+ */
+struct OrderStruct *OrderPoolGet(OrderPool *pool);
+
+/**
+ * Gives an order back to the pool. Safe from any thread.
+ */
+void OrderPoolPut(OrderPool *pool, struct OrderStruct *order);
+
+#endif  // LAB3_ORDERPOOL_H_
@@ -0,0 +1,44 @@
+#ifndef LAB3_RESTAURANT_INTERNAL_H_
+#define LAB3_RESTAURANT_INTERNAL_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+// Helpers the restaurant's own files (BENSCHILLIBOWL.c, kitchen.c,
+// cookpool.c, sharedrestaurant.c) and its programs share. Not part of the
+// API in BENSCHILLIBOWL.h. Includers define _POSIX_C_SOURCE (or
+// _XOPEN_SOURCE) first, for clock_gettime.
+
+/* CLOCK_MONOTONIC in ns: the clock every Order time and deadline is on */
+static inline uint64_t NowNs(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* signal n of the threads (or processes) waiting on cond, or all of them
+   if that's fewer; call with cond's mutex held */
+static inline void WakeWaiters(pthread_cond_t *cond, int waiting, int n) {
+    if (waiting == 0) return;
+    if (waiting <= n) {
+        pthread_cond_broadcast(cond);
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        pthread_cond_signal(cond);
+    }
+}
+
+/* single-writer increment that a concurrent reader may safely observe */
+static inline void StatAdd(uint64_t *counter, uint64_t n) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n,
+                     __ATOMIC_RELAXED);
+}
+
+/* read a counter some other thread StatAdds to */
+static inline uint64_t StatLoad(const uint64_t *counter) {
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+#endif  // LAB3_RESTAURANT_INTERNAL_H_
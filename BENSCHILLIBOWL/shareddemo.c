@@ -0,0 +1,129 @@
+// shareddemo.c — customers and cooks as separate processes, sharing one
+// restaurant through POSIX shared memory (sharedrestaurant.h).
+//
+// Build: make shareddemo
+// Run:   ./shareddemo [customers] [cooks] [orders per customer] [--seed N]
+//
+// The parent opens the restaurant under a name of its own (with its pid,
+// so runs side by side don't meet) and forks every customer and cook. Each
+// child attaches to the restaurant by that name, so it gets a mapping of its
+// own, as an unrelated process would, and closes it when done. The parent
+// waits for them all, then closes the restaurant (or, if anything failed,
+// discards it), so the name never outlives the run.
+
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "BENSCHILLIBOWL.h"
+#include "sharedrestaurant.h"
+
+#define SHARED_NAME_PREFIX "/benschillibowl"
+#define SHARED_SIZE 100
+#define COOK_BATCH 4
+#define MAX_ORDERS_PER_CUSTOMER 64
+
+static char shared_name[64];  // SHARED_NAME_PREFIX.<parent pid>, set before the forks
+
+static void Customer(int customer_id, int num_orders) {
+    SharedRestaurant *sr = AttachSharedRestaurant(shared_name);
+    if (!sr) {
+        fprintf(stderr, "Customer #%d could not attach to %s\n", customer_id, shared_name);
+        exit(1);
+    }
+    SeedThreadRandom((uint64_t)customer_id);  // same picks on every run with one --seed
+
+    Order ords[MAX_ORDERS_PER_CUSTOMER];
+    memset(ords, 0, sizeof(ords));
+    for (int i = 0; i < num_orders; i++) {
+        ords[i].menu_item = PickRandomMenuItem();
+        ords[i].customer_id = customer_id;
+        ords[i].priority = (uint8_t)(customer_id % ORDER_PRIORITY_LEVELS);
+    }
+    AddSharedOrders(sr, ords, num_orders);
+    CloseSharedRestaurant(sr);
+}
+
+static void Cook(int cook_id) {
+    SharedRestaurant *sr = AttachSharedRestaurant(shared_name);
+    if (!sr) {
+        fprintf(stderr, "Cook #%d could not attach to %s\n", cook_id, shared_name);
+        exit(1);
+    }
+
+    int orders_fulfilled = 0;
+    Order ords[COOK_BATCH];
+    for (;;) {
+        int n = GetSharedOrders(sr, ords, COOK_BATCH);
+        if (n == 0) break;  // no more work
+        orders_fulfilled += n;
+    }
+    printf("Cook #%d (pid %d) fulfilled %d orders\n", cook_id, (int)getpid(), orders_fulfilled);
+    CloseSharedRestaurant(sr);
+}
+
+int main(int argc, char **argv) {
+    int counts[3] = { 90, 10, 3 };  // customers, cooks, orders per customer
+    int ncounts = 0;
+    bool bad = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) SeedRandom(strtoull(argv[++i], NULL, 0));
+        else if (ncounts < 3 && atoi(argv[i]) > 0) counts[ncounts++] = atoi(argv[i]);
+        else bad = true;
+    }
+    if (bad || counts[2] > MAX_ORDERS_PER_CUSTOMER) {
+        fprintf(stderr, "Usage: %s [customers] [cooks] [orders per customer (<= %d)] [--seed N]\n",
+                argv[0], MAX_ORDERS_PER_CUSTOMER);
+        return 1;
+    }
+    int num_customers = counts[0], num_cooks = counts[1], per_customer = counts[2];
+
+    snprintf(shared_name, sizeof(shared_name), "%s.%d", SHARED_NAME_PREFIX, (int)getpid());
+    SharedRestaurant *sr = OpenSharedRestaurant(shared_name, SHARED_SIZE, num_customers * per_customer);
+    if (!sr) {
+        fprintf(stderr, "OpenSharedRestaurant %s: %s\n", shared_name, strerror(errno));
+        return 1;
+    }
+    fflush(stdout);  // or every child flushes a copy of it
+
+    int nprocs = num_cooks + num_customers;
+    pid_t *pids = (pid_t*)calloc(nprocs, sizeof(pid_t));
+    int failed = pids ? 0 : 1;
+    for (int i = 0; pids && i < nprocs; i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (i < num_cooks) Cook(i + 1);
+            else Customer(i - num_cooks + 1, per_customer);
+            fflush(stdout);
+            _exit(0);
+        }
+        if (pid < 0) {
+            /* the others would wait forever for the missing orders */
+            perror("fork");
+            failed++;
+            for (int j = 0; j < i; j++) kill(pids[j], SIGTERM);
+            break;
+        }
+        pids[i] = pid;
+    }
+    free(pids);
+
+    int status;
+    while (wait(&status) > 0) {
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) failed++;
+    }
+    if (failed) {
+        /* some orders never arrived or were never cooked: don't assert on it */
+        fprintf(stderr, "%d process(es) failed\n", failed);
+        DiscardSharedRestaurant(sr);
+        return 1;
+    }
+    CloseSharedRestaurant(sr);
+    return 0;
+}
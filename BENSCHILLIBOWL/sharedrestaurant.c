@@ -0,0 +1,332 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sharedrestaurant.h"
+#include "restaurant_internal.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Written last by the creator: an attacher that sees it sees the rest.
+#define SHARED_MAGIC 0x42434231u  // "BCB1"
+
+// Most processes (or threads) the segment tracks asleep at once; more
+// still wait, they just can't be uncounted if they die (see Sleeper).
+#define SHARED_MAX_SLEEPERS 256
+
+enum { SLEEPER_NONE, SLEEPER_CUSTOMER, SLEEPER_COOK };
+
+// Who is counted in waiting_customers or waiting_cooks. A waiter that dies
+// asleep, or woken but before it uncounts itself, would leave its count up
+// for good; whoever next recovers the mutex (RecoverShared) finds its pid
+// gone and takes its count back.
+typedef struct {
+    pid_t pid;
+    int role;  // SLEEPER_*
+} Sleeper;
+
+// An Order without its next pointer, alone on its cache line.
+typedef struct {
+    _Alignas(CACHE_LINE) int customer_id;
+    int order_number;
+    uint8_t menu_item;
+    uint8_t priority;
+    uint64_t enqueued_at;
+    uint64_t deadline;
+} OrderSlot;
+
+// Everything in the segment, laid out like BENSCHILLIBOWL: configuration,
+// synchronization, producer side, consumer side, then max_size slots.
+// The ring is two running totals instead of head, tail and a size: order
+// `added` goes in slot added % max_size, and the queue holds added - taken.
+// Moving an order in or out is one store to one of them, ordered after
+// the slot is written or read, so a process that dies holding the mutex
+// leaves the ring consistent.
+struct SharedRestaurantState {
+    atomic_uint magic;
+    int max_size;
+    int expected_num_orders;
+
+    _Alignas(CACHE_LINE) pthread_mutex_t mutex;
+    int waiting_customers;
+    int waiting_cooks;
+    int num_sleepers;  // sleepers[] in use or free again below this
+    Sleeper sleepers[SHARED_MAX_SLEEPERS];
+    _Alignas(CACHE_LINE) pthread_cond_t can_add_orders;
+    _Alignas(CACHE_LINE) pthread_cond_t can_get_orders;
+
+    _Alignas(CACHE_LINE) int added;  // orders ever put in the ring
+    int next_order_number;
+
+    _Alignas(CACHE_LINE) int taken;  // orders ever taken out: the orders handled
+
+    OrderSlot slots[];
+};
+
+// One process's view of the segment.
+struct SharedRestaurant {
+    struct SharedRestaurantState *state;
+    size_t map_size;
+    pid_t creator;  // opened it, so tears it down
+    char *name;
+};
+
+static size_t SegmentSize(int max_size) {
+    return sizeof(struct SharedRestaurantState) + (size_t)max_size * sizeof(OrderSlot);
+}
+
+/* map fd (closing it) and wrap it in a handle */
+static SharedRestaurant *MapSegment(int fd, size_t size, const char *name) {
+    SharedRestaurant *sr = (SharedRestaurant*)malloc(sizeof(SharedRestaurant));
+    void *p = MAP_FAILED;
+    if (sr) p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        free(sr);
+        return NULL;
+    }
+    sr->state = (struct SharedRestaurantState*)p;
+    sr->map_size = size;
+    sr->creator = 0;
+    sr->name = strdup(name);
+    return sr;
+}
+
+static void UnmapSegment(SharedRestaurant *sr) {
+    munmap(sr->state, sr->map_size);
+    free(sr->name);
+    free(sr);
+}
+
+/* creator only, once nobody else uses it: tear down and remove the name.
+   The condition variables go with the segment undestroyed: glibc's
+   pthread_cond_destroy waits for every waiter to leave, and one that died
+   asleep never does. */
+static void DestroySegment(SharedRestaurant *sr) {
+    pthread_mutex_destroy(&sr->state->mutex);
+    shm_unlink(sr->name);
+    UnmapSegment(sr);
+}
+
+static int *WaitingCount(struct SharedRestaurantState *s, int role) {
+    return role == SLEEPER_COOK ? &s->waiting_cooks : &s->waiting_customers;
+}
+
+static void TrimSleepers(struct SharedRestaurantState *s) {
+    while (s->num_sleepers > 0 && s->sleepers[s->num_sleepers - 1].role == SLEEPER_NONE) {
+        s->num_sleepers--;
+    }
+}
+
+/* a process that died holding the mutex left the ring consistent (see
+   SharedRestaurantState), so just carry on. What it was doing is lost: a
+   customer's orders not yet added never arrive, and a cook's orders
+   taken but not yet cooked are gone with it. Dead sleepers are uncounted,
+   and everyone asleep rechecks, in case a dead one had been sent the
+   wakeup meant for them. (A dead process is only gone once reaped.) */
+static void RecoverShared(struct SharedRestaurantState *s) {
+    pthread_mutex_consistent(&s->mutex);
+    for (int i = 0; i < s->num_sleepers; i++) {
+        Sleeper *z = &s->sleepers[i];
+        if (z->role == SLEEPER_NONE || kill(z->pid, 0) == 0 || errno != ESRCH) continue;
+        (*WaitingCount(s, z->role))--;
+        z->role = SLEEPER_NONE;
+    }
+    TrimSleepers(s);
+    pthread_cond_broadcast(&s->can_add_orders);
+    pthread_cond_broadcast(&s->can_get_orders);
+}
+
+static void LockShared(struct SharedRestaurantState *s) {
+    if (pthread_mutex_lock(&s->mutex) == EOWNERDEAD) RecoverShared(s);
+}
+
+/* sleep on cond, counted as role while asleep */
+static void WaitShared(struct SharedRestaurantState *s, pthread_cond_t *cond, int role) {
+    int me = 0;
+    while (me < s->num_sleepers && s->sleepers[me].role != SLEEPER_NONE) me++;
+    if (me < SHARED_MAX_SLEEPERS) {
+        if (me == s->num_sleepers) s->num_sleepers++;
+        s->sleepers[me].pid = getpid();
+        s->sleepers[me].role = role;
+    }
+    (*WaitingCount(s, role))++;
+
+    if (pthread_cond_wait(cond, &s->mutex) == EOWNERDEAD) RecoverShared(s);
+
+    /* RecoverShared never uncounts us: we are alive */
+    (*WaitingCount(s, role))--;
+    if (me < SHARED_MAX_SLEEPERS) s->sleepers[me].role = SLEEPER_NONE;
+    TrimSleepers(s);
+}
+
+SharedRestaurant *OpenSharedRestaurant(const char* name, int max_size, int expected_num_orders) {
+    if (max_size <= 0) max_size = 1;
+    size_t size = SegmentSize(max_size);
+
+    /* never take over a name: it may be another run's live segment */
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, (off_t)size) < 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    SharedRestaurant *sr = MapSegment(fd, size, name);
+    if (!sr) {
+        shm_unlink(name);
+        return NULL;
+    }
+    sr->creator = getpid();
+
+    /* ftruncate zero-filled the segment: every position starts at 0 */
+    struct SharedRestaurantState *s = sr->state;
+    s->max_size = max_size;
+    s->expected_num_orders = expected_num_orders;
+    s->next_order_number = 1;  // start order numbering at 1
+
+    pthread_mutexattr_t mattr;
+    pthread_mutexattr_init(&mattr);
+    pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&s->mutex, &mattr);
+    pthread_mutexattr_destroy(&mattr);
+
+    pthread_condattr_t cattr;
+    pthread_condattr_init(&cattr);
+    pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+    pthread_cond_init(&s->can_add_orders, &cattr);
+    pthread_cond_init(&s->can_get_orders, &cattr);
+    pthread_condattr_destroy(&cattr);
+
+    atomic_store_explicit(&s->magic, SHARED_MAGIC, memory_order_release);
+    printf("Restaurant is open!\n");
+    return sr;
+}
+
+SharedRestaurant *AttachSharedRestaurant(const char* name) {
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct SharedRestaurantState)) {
+        close(fd);
+        return NULL;
+    }
+    SharedRestaurant *sr = MapSegment(fd, (size_t)st.st_size, name);
+    if (!sr) return NULL;
+
+    struct SharedRestaurantState *s = sr->state;
+    if (atomic_load_explicit(&s->magic, memory_order_acquire) != SHARED_MAGIC ||
+        SegmentSize(s->max_size) > sr->map_size) {
+        UnmapSegment(sr);
+        return NULL;
+    }
+    return sr;
+}
+
+void CloseSharedRestaurant(SharedRestaurant* sr) {
+    if (sr->creator != getpid()) {
+        UnmapSegment(sr);
+        return;
+    }
+
+    struct SharedRestaurantState *s = sr->state;
+    LockShared(s);
+    assert(s->added == s->taken);
+    assert(s->taken == s->expected_num_orders);
+    pthread_mutex_unlock(&s->mutex);
+
+    DestroySegment(sr);
+    printf("Restaurant is closed!\n");
+}
+
+void DiscardSharedRestaurant(SharedRestaurant* sr) {
+    if (sr->creator != getpid()) UnmapSegment(sr);
+    else DestroySegment(sr);
+}
+
+int AddSharedOrder(SharedRestaurant* sr, const Order* order) {
+    return AddSharedOrders(sr, order, 1);
+}
+
+bool GetSharedOrder(SharedRestaurant* sr, Order* out) {
+    return GetSharedOrders(sr, out, 1) == 1;
+}
+
+/* add n orders with contiguous order numbers, as many per lock hold as fit */
+int AddSharedOrders(SharedRestaurant* sr, const Order* orders, int n) {
+    if (n <= 0) return 0;
+    struct SharedRestaurantState *s = sr->state;
+    LockShared(s);
+
+    int first = s->next_order_number;
+    s->next_order_number += n;
+
+    int added = 0;
+    while (added < n) {
+        while (s->added - s->taken >= s->max_size) {
+            WaitShared(s, &s->can_add_orders, SLEEPER_CUSTOMER);
+        }
+
+        int room = s->max_size - (s->added - s->taken);
+        int batch = (n - added < room) ? n - added : room;
+        for (int i = 0; i < batch; i++) {
+            const Order *order = &orders[added + i];
+            OrderSlot *slot = &s->slots[s->added % s->max_size];
+            slot->customer_id = order->customer_id;
+            slot->order_number = first + added + i;
+            slot->menu_item = order->menu_item;
+            slot->priority = order->priority;
+            slot->enqueued_at = order->enqueued_at;
+            slot->deadline = order->deadline;
+            __atomic_store_n(&s->added, s->added + 1, __ATOMIC_RELEASE);  // publishes the slot
+        }
+        added += batch;
+
+        WakeWaiters(&s->can_get_orders, s->waiting_cooks, batch);
+    }
+    pthread_mutex_unlock(&s->mutex);
+    return first;
+}
+
+/* remove up to max orders in one lock hold; 0 when everything is done */
+int GetSharedOrders(SharedRestaurant* sr, Order* out, int max) {
+    if (max <= 0) return 0;
+    struct SharedRestaurantState *s = sr->state;
+    LockShared(s);
+
+    while (s->added == s->taken && s->taken < s->expected_num_orders) {
+        WaitShared(s, &s->can_get_orders, SLEEPER_COOK);
+    }
+
+    int queued = s->added - s->taken;
+    if (queued == 0) {
+        /* Tell one idle cook to wake up and exit; it tells the next */
+        if (s->waiting_cooks > 0) pthread_cond_signal(&s->can_get_orders);
+        pthread_mutex_unlock(&s->mutex);
+        return 0;
+    }
+
+    int taken = (max < queued) ? max : queued;
+    for (int i = 0; i < taken; i++) {
+        const OrderSlot *slot = &s->slots[s->taken % s->max_size];
+        out[i].next = NULL;
+        out[i].customer_id = slot->customer_id;
+        out[i].order_number = slot->order_number;
+        out[i].menu_item = slot->menu_item;
+        out[i].priority = slot->priority;
+        out[i].enqueued_at = slot->enqueued_at;
+        out[i].deadline = slot->deadline;
+        __atomic_store_n(&s->taken, s->taken + 1, __ATOMIC_RELEASE);  // frees the slot
+    }
+
+    WakeWaiters(&s->can_add_orders, s->waiting_customers, taken);
+    pthread_mutex_unlock(&s->mutex);
+    return taken;
+}
@@ -0,0 +1,67 @@
+#ifndef LAB3_SHAREDRESTAURANT_H_
+#define LAB3_SHAREDRESTAURANT_H_
+
+#include <stdbool.h>
+
+#include "BENSCHILLIBOWL.h"
+
+// A restaurant whose queue lives in POSIX shared memory (shm_open + mmap),
+// so customers and cooks can be separate processes. It is the QUEUE_MUTEX
+// ring, laid out to work in every mapping:
+//  - orders are stored inline, one cache-line slot each, and the segment
+//    holds no pointers (ring positions are indices), so each process may
+//    map it at a different address;
+//  - the mutex and condition variables are PTHREAD_PROCESS_SHARED, and
+//    the mutex is robust: if a process dies holding it, the next process
+//    to lock it takes it over instead of hanging, and stops counting any
+//    waiter that has died as asleep.
+// AddSharedOrders writes each order straight into its slot and
+// GetSharedOrders reads it straight out; nothing else is copied.
+// Order.next is neither stored nor returned.
+typedef struct SharedRestaurant SharedRestaurant;
+
+/**
+ * Creates the shared restaurant `name` (a shm_open name, e.g.
+ * "/benschillibowl.<pid>") with a maximum size and the expected number of
+ * orders, and maps it. Returns NULL on failure, with errno EEXIST if
+ * something (perhaps another run) already has that name.
+ */
+SharedRestaurant *OpenSharedRestaurant(const char* name, int max_size, int expected_num_orders);
+
+/**
+ * Maps a shared restaurant another process opened. Returns NULL if there
+ * is none under name (or it isn't set up yet).
+ */
+SharedRestaurant *AttachSharedRestaurant(const char* name);
+
+/**
+ * Unmaps the restaurant. In the process that opened it, this first checks
+ * (like CloseRestaurant) that every expected order was handled, then
+ * destroys the synchronization objects and removes the name; call it
+ * after everyone else has closed.
+ */
+void CloseSharedRestaurant(SharedRestaurant* sr);
+
+/**
+ * CloseSharedRestaurant without the checks or output: for giving up on a
+ * run, e.g. after a child failed. The creator still removes the name, so
+ * nothing is left in /dev/shm.
+ */
+void DiscardSharedRestaurant(SharedRestaurant* sr);
+
+/**
+ * AddOrders / AddOrder: wait for room, copy orders[0..n-1] into slots
+ * and give them contiguous order numbers. Returns the first one.
+ */
+int AddSharedOrders(SharedRestaurant* sr, const Order* orders, int n);
+int AddSharedOrder(SharedRestaurant* sr, const Order* order);
+
+/**
+ * GetOrders / GetOrder: wait until the restaurant is not empty, then copy
+ * up to max orders out of their slots into out. Return the number taken
+ * (GetSharedOrder: whether one was); 0 means there are no orders left.
+ */
+int GetSharedOrders(SharedRestaurant* sr, Order* out, int max);
+bool GetSharedOrder(SharedRestaurant* sr, Order* out);
+
+#endif  // LAB3_SHAREDRESTAURANT_H_
@@ -0,0 +1,74 @@
+#include "workdeque.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+bool WorkDequeInit(WorkDeque *q, int capacity) {
+    long size = 1;
+    while (size < capacity) size <<= 1;
+
+    q->buffer = calloc((size_t)size, sizeof(*q->buffer));
+    if (!q->buffer) return false;
+    q->mask = size - 1;
+    atomic_init(&q->top, 0);
+    atomic_init(&q->bottom, 0);
+    return true;
+}
+
+void WorkDequeDestroy(WorkDeque *q) {
+    free(q->buffer);
+    q->buffer = NULL;
+}
+
+void WorkDequePush(WorkDeque *q, struct OrderStruct *order) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    assert(b - t <= q->mask);  /* never grows; caller bounds the contents */
+    (void)t;
+
+    atomic_store_explicit(&q->buffer[b & q->mask], order, memory_order_relaxed);
+    /* publishes the slot (and the order's contents) to thieves */
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+}
+
+struct OrderStruct *WorkDequePop(WorkDeque *q) {
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+
+    if (t > b) {
+        /* was already empty */
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    struct OrderStruct *order = atomic_load_explicit(&q->buffer[b & q->mask],
+                                                     memory_order_relaxed);
+    if (t == b) {
+        /* last one: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed)) {
+            order = NULL;
+        }
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return order;
+}
+
+struct OrderStruct *WorkDequeSteal(WorkDeque *q) {
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+
+    struct OrderStruct *order = atomic_load_explicit(&q->buffer[t & q->mask],
+                                                     memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst,
+                                                 memory_order_relaxed)) {
+        return NULL;
+    }
+    return order;
+}
@@ -0,0 +1,39 @@
+#ifndef LAB3_WORKDEQUE_H_
+#define LAB3_WORKDEQUE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+struct OrderStruct;
+
+// A Chase-Lev work-stealing deque of orders with a fixed capacity.
+// Only the owning thread may push or pop (at the bottom); any thread may
+// steal (from the top). Capacity is rounded up to a power of two and the
+// deque never grows, so callers must bound how many orders it can hold.
+// top (thieves) and bottom (owner) sit on separate cache lines.
+typedef struct {
+    _Alignas(64) atomic_long top;
+    _Alignas(64) atomic_long bottom;
+    _Atomic(struct OrderStruct*) *buffer;
+    long mask;
+} WorkDeque;
+
+/**
+ * Allocates room for at least `capacity` orders. Returns false on failure.
+ */
+bool WorkDequeInit(WorkDeque *q, int capacity);
+void WorkDequeDestroy(WorkDeque *q);
+
+/**
+ * Owner only: push at / pop from the bottom. Pop returns NULL when empty.
+ */
+void WorkDequePush(WorkDeque *q, struct OrderStruct *order);
+struct OrderStruct *WorkDequePop(WorkDeque *q);
+
+/**
+ * Any thread: take the order at the top. Returns NULL when the deque is
+ * empty or another thread won the race for that order.
+ */
+struct OrderStruct *WorkDequeSteal(WorkDeque *q);
+
+#endif  // LAB3_WORKDEQUE_H_
@@ -0,0 +1,91 @@
+// bank_bench.h — --bench support for the bank engine (bank_engine.c).
+//
+// Under --bench every process runs a fixed number of operations and
+// records, in its own BenchSlot:
+//  - op:   how long each operation took (think time excluded)
+//  - wait: how long it took to get the account lock
+//  - hold: how long the lock was then held
+// (wait and hold are only recorded by the single-lock modes; --atomic
+// takes no lock and --ledger takes one or two per operation)
+// The slots live in the shared memory the parent maps before forking;
+// after waitpid() it merges them with BenchReport().
+// Latencies go into the same histograms BENSCHILLIBOWL's bench uses
+// (histogram.h).
+
+#ifndef LAB3_BANK_BENCH_H_
+#define LAB3_BANK_BENCH_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "histogram.h"
+
+typedef struct {
+    char role[24];
+    int pid;
+    uint64_t ops;
+    uint64_t begin, end;  // BenchNow() at the first operation and after the last
+    Histogram op;
+    Histogram wait;
+    Histogram hold;
+} BenchSlot;
+
+static inline uint64_t BenchNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void BenchPrintHist(const char *name, const Histogram *h) {
+    if (h->total == 0) {
+        printf("  %s -", name);
+        return;
+    }
+    printf("  %s p50/p99/max = %llu/%llu/%llu ns", name,
+           (unsigned long long)HistogramPercentile(h, 0.50),
+           (unsigned long long)HistogramPercentile(h, 0.99),
+           (unsigned long long)h->max);
+}
+
+static inline void BenchPrintLine(const char *who, uint64_t ops, uint64_t ns,
+                                  const Histogram *op, const Histogram *wait,
+                                  const Histogram *hold) {
+    double secs = (double)ns / 1e9;
+    printf("%-18s %9llu ops %10.0f ops/s", who, (unsigned long long)ops,
+           secs > 0 ? (double)ops / secs : 0.0);
+    BenchPrintHist("op", op);
+    BenchPrintHist("wait", wait);
+    BenchPrintHist("hold", hold);
+    printf("\n");
+}
+
+/**
+ * Prints one line per process and a total: the total rate is all
+ * operations over the wall time from the first start to the last finish.
+ */
+static inline void BenchReport(const BenchSlot *slots, int n, const char *mode) {
+    static Histogram op, wait, hold;  // large; merged once, at exit
+    HistogramReset(&op);
+    HistogramReset(&wait);
+    HistogramReset(&hold);
+    uint64_t ops = 0, begin = UINT64_MAX, end = 0;
+
+    printf("--- bench: %s, %d roles ---\n", mode, n);
+    for (int i = 0; i < n; i++) {
+        char who[40];
+        snprintf(who, sizeof(who), "%s[%d]", slots[i].role, slots[i].pid);
+        BenchPrintLine(who, slots[i].ops, slots[i].end - slots[i].begin, &slots[i].op,
+                       &slots[i].wait, &slots[i].hold);
+        HistogramMerge(&op, &slots[i].op);
+        HistogramMerge(&wait, &slots[i].wait);
+        HistogramMerge(&hold, &slots[i].hold);
+        ops += slots[i].ops;
+        if (slots[i].begin < begin) begin = slots[i].begin;
+        if (slots[i].end > end) end = slots[i].end;
+    }
+    BenchPrintLine("total", ops, n > 0 ? end - begin : 0, &op, &wait, &hold);
+    fflush(stdout);
+}
+
+#endif  // LAB3_BANK_BENCH_H_
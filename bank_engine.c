@@ -0,0 +1,1010 @@
+// bank_engine.c — the bank simulation shared by psdd, psdd_ec, shm_proc and bank_sim.
+//
+// Dear Old Dad, Lovable Mom and N Poor Students each run as a forked
+// process over one shared Shared struct; the parent only supervises: it
+// prints the event log, runs the journal syncer, and reports --bench.
+// With --threads the roles are instead threads of one worker process, and
+// with --procs M they are dealt out over M worker processes, as threads.
+//
+// Where Shared lives is up to a provider (see providers[]), and how the
+// balance is guarded is up to a lock backend (see backends[]), so the
+// same roles can be compared across IPC and lock choices:
+//   ./bank_sim --bench --provider sysv --lock sem 2 64
+//
+// Build: make bank_engine.o (the programs link it in)
+// Stop:  Ctrl-C (parent will SIGTERM all children and cleanup)
+
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE  // syscall() for the futex lock, SysV shm
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/ipc.h>
+#include <sys/mman.h>
+#include <sys/shm.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+#include "bank_engine.h"
+#include "bank_lock.h"
+#include "ledger.h"
+#include "bank_bench.h"
+#include "event_log.h"
+#include "journal.h"
+#include "bank_seqlock.h"
+#include "rng.h"
+
+#define SHM_FILE "bank.mem"
+#define SHM_NAME "/bank_sim"
+#define SEM_NAME "/bank_mutex_sem"
+
+// BankAccount is guarded by the lock backend. Check Balance reads it
+// without the lock, through balance_seq (bank_seqlock.h); --locked-reads
+// takes the lock for those too.
+// With --lock atomic the processes use AtomicBankAccount instead and take
+// no lock: deposits are a fetch-add and withdrawals a compare-and-swap
+// loop. A lock-free atomic is address-free, so it works across processes
+// that map the memory at different addresses.
+// With --lock ledger every student has an account of its own in
+// accounts[] (see ledger.h), and the fields above are unused.
+typedef struct {
+    BankLock lock;
+    int BankAccount;
+    Seqlock balance_seq;
+    atomic_llong AtomicBankAccount;
+    int num_accounts;
+    Account accounts[];
+} Shared;
+
+_Static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "--lock atomic needs a lock-free 64-bit atomic");
+
+// The provider maps one region for everything the processes share:
+// Shared (with the ledger's accounts), then the event ring, then the
+// --bench slots, each starting on its own cache line.
+#define REGION_ALIGN(n) (((n) + 63) & ~(size_t)63)
+
+static void *region = NULL;
+static size_t region_size = 0;
+static Shared *S = NULL;
+
+static bool locked_reads = false;
+static int read_pct = 50;      // share of Dad / Student turns that only check the balance
+
+static pid_t *child_pids = NULL;
+static int child_count = 0;    // worker processes
+static int role_count = 0;     // Dad, Mom, students
+static int num_parents = 1;
+
+// --threads / --procs M: each worker process runs its roles as threads;
+// without either, every role is a worker process of its own.
+#define ROLE_THREAD_STACK (256 * 1024)
+static bool use_threads = false;
+static int num_procs = 1;
+
+static volatile sig_atomic_t shutting_down = 0;
+
+// --kill-holder: the last role SIGKILLs its own process the first time it
+// holds the account lock, leaving the lock to dead-owner recovery.
+static bool kill_holder = false;
+static _Thread_local bool dies_holding = false;
+
+// --bench: each process does bench_ops operations, pausing think_us
+// between them, and prints nothing; its numbers go to its own slot in
+// bench_slots for the parent to report.
+static bool bench = false;
+static long bench_ops = 10000;
+static long think_us = 0;
+static BenchSlot *bench_slots = NULL;
+static _Thread_local BenchSlot *my_slot = NULL;
+static _Thread_local uint64_t op_start, lock_taken;
+
+// --journal: every change to BankAccount is first appended to bank.wal
+// (journal.h), which a thread in the parent flushes every sync_ms; at
+// startup the balance comes from the journal instead of being reset.
+static bool use_journal = false;
+static long sync_ms = 10;
+static Journal journal = { .fd = -1 };
+
+/* ------- printing helper ------- */
+static void say(const char *fmt, ...) {
+    if (bench) return;
+    va_list ap;
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    fflush(stdout);
+}
+
+/* ------- shared memory providers ------- */
+// map() returns the region zero-filled or left over from an earlier run,
+// or NULL after perror(). unmap() also removes any name the region has.
+typedef struct {
+    const char *name;
+    void *(*map)(size_t size);
+    void (*unmap)(void *p, size_t size);
+} Provider;
+
+static void *map_fd(int fd, size_t size) {
+    void *p = NULL;
+    if (ftruncate(fd, (off_t)size) < 0) perror("ftruncate");
+    else if ((p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        perror("mmap");
+        p = NULL;
+    }
+    close(fd);  // the mapping keeps the memory
+    return p;
+}
+
+/* a file the next run (and --replay-check) can look at */
+static void *file_map(size_t size) {
+    int fd = open(SHM_FILE, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) { perror("open " SHM_FILE); return NULL; }
+    return map_fd(fd, size);
+}
+
+/* POSIX shared memory: a named tmpfs object */
+static void *posix_map(size_t size) {
+    int fd = shm_open(SHM_NAME, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) { perror("shm_open " SHM_NAME); return NULL; }
+    return map_fd(fd, size);
+}
+
+static void posix_unmap(void *p, size_t size) {
+    munmap(p, size);
+    shm_unlink(SHM_NAME);
+}
+
+/* System V shared memory; marked for removal as soon as it is attached,
+ * so it goes away with the last process even after a kill -9 */
+static void *sysv_map(size_t size) {
+    int id = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600);
+    if (id < 0) { perror("shmget"); return NULL; }
+    void *p = shmat(id, NULL, 0);
+    shmctl(id, IPC_RMID, NULL);
+    if (p == (void *)-1) { perror("shmat"); return NULL; }
+    return p;
+}
+
+static void sysv_unmap(void *p, size_t size) {
+    (void)size;
+    shmdt(p);
+}
+
+/* anonymous shared mapping: inherited over fork, no name at all */
+static void *anon_map(size_t size) {
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) { perror("mmap"); return NULL; }
+    return p;
+}
+
+static void plain_unmap(void *p, size_t size) {
+    munmap(p, size);
+}
+
+static const Provider providers[] = {
+    { "file",  file_map,  plain_unmap },
+    { "posix", posix_map, posix_unmap },
+    { "sysv",  sysv_map,  sysv_unmap  },
+    { "anon",  anon_map,  plain_unmap },
+};
+
+static const Provider *provider = NULL;
+
+/* ------- lock backends ------- */
+// A backend either locks the one balance (MODEL_LOCKED) or replaces the
+// locking altogether: --lock atomic and --lock ledger have roles of their own.
+// A process-private backend only works when all the roles share one
+// process (--threads).
+enum { MODEL_LOCKED, MODEL_ATOMIC, MODEL_LEDGER, MODEL_COUNT };
+
+typedef struct {
+    const char *name;
+    int model;
+    bool process_private;
+    bool (*open)(void);       // before the forks; false after perror()
+    void (*close)(void);
+    bool (*acquire)(void);    // true if the lock was taken over from a dead owner
+    void (*release)(void);
+} LockBackend;
+
+/* BankLock's owner id (bank_lock.h): our pid, forgotten again in a forked child */
+pid_t bank_lock_pid;
+static pthread_once_t bank_lock_once = PTHREAD_ONCE_INIT;
+
+static void bank_lock_forget_pid(void) {
+    bank_lock_pid = 0;
+}
+
+static void bank_lock_register_fork(void) {
+    pthread_atfork(NULL, NULL, bank_lock_forget_pid);
+}
+
+void BankLockCachePid(void) {
+    pthread_once(&bank_lock_once, bank_lock_register_fork);
+    bank_lock_pid = getpid();
+}
+
+static bool futex_acquire(void) { return BankLockAcquire(&S->lock); }
+static void futex_release(void) { BankLockRelease(&S->lock); }
+
+static sem_t *mutex = NULL;    // only with --lock sem
+
+static bool sem_backend_open(void) {
+    mutex = sem_open(SEM_NAME, O_CREAT, 0644, 1);
+    if (mutex == SEM_FAILED) { mutex = NULL; perror("sem_open"); return false; }
+    return true;
+}
+
+static void sem_backend_close(void) {
+    if (!mutex) return;
+    sem_close(mutex);
+    sem_unlink(SEM_NAME);
+    mutex = NULL;
+}
+
+static bool sem_acquire(void) { sem_wait(mutex); return false; }
+static void sem_release(void) { sem_post(mutex); }
+
+/* process-private: the same futex lock without the shared-mapping lookup */
+static bool futex_private_acquire(void) { return BankLockAcquirePrivate(&S->lock); }
+static void futex_private_release(void) { BankLockReleasePrivate(&S->lock); }
+
+/* process-private: a plain pthread mutex in the worker's own memory */
+static pthread_mutex_t private_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool mutex_acquire(void) { pthread_mutex_lock(&private_mutex); return false; }
+static void mutex_release(void) { pthread_mutex_unlock(&private_mutex); }
+
+static const LockBackend backends[] = {
+    { "futex",         MODEL_LOCKED, false, NULL, NULL, futex_acquire, futex_release },
+    { "sem",           MODEL_LOCKED, false, sem_backend_open, sem_backend_close, sem_acquire, sem_release },
+    { "atomic",        MODEL_ATOMIC, false, NULL, NULL, NULL, NULL },
+    { "ledger",        MODEL_LEDGER, false, NULL, NULL, NULL, NULL },
+    { "futex-private", MODEL_LOCKED, true,  NULL, NULL, futex_private_acquire, futex_private_release },
+    { "mutex",         MODEL_LOCKED, true,  NULL, NULL, mutex_acquire, mutex_release },
+};
+
+static const LockBackend *backend = NULL;
+
+/* ------- event log: roles append records, the parent prints them ------- */
+// Printing under the account lock would make every hold as long as a
+// write(2) to the terminal, so the roles only append to the shared ring
+// (event_log.h) and the parent formats the text.
+enum { ROLE_DAD, ROLE_MOM, ROLE_STUDENT };
+enum { EV_ATTEMPT, EV_DEPOSIT, EV_NO_MONEY, EV_ENOUGH, EV_BALANCE,
+       EV_NEEDS, EV_WITHDRAW, EV_SHORT, EV_BORROW };
+
+static EventLog *events = NULL;  // in the shared region
+
+/* student is -1 unless --lock ledger; other is the second student of a loan */
+static void log_event(int role, int op, int student, int amount, long long balance, int other) {
+    if (bench) return;
+    EventRecord r = {
+        .ns = EventLogNow(), .balance = balance, .pid = (int32_t)getpid(), .amount = amount,
+        .student = (int16_t)student, .other = (int16_t)other,
+        .role = (uint8_t)role, .op = (uint8_t)op,
+    };
+    EventLogAppend(events, &r);
+}
+
+static void print_event(const EventRecord *e) {
+    int a = e->amount, st = e->student;
+    long long bal = (long long)e->balance;
+    switch (e->role) {
+    case ROLE_DAD:
+        switch (e->op) {
+        case EV_ATTEMPT:  printf("Dear Old Dad: Attempting to Check Balance\n"); break;
+        case EV_NO_MONEY: printf("Dear Old Dad: Doesn't have any money to give\n"); break;
+        case EV_DEPOSIT:
+            if (st < 0) printf("Dear Old Dad: Deposits $%d / Balance = $%lld\n", a, bal);
+            else printf("Dear Old Dad: Deposits $%d for Student %d / Balance = $%lld\n", a, st, bal);
+            break;
+        case EV_ENOUGH:
+            if (st < 0) printf("Dear old Dad: Thinks Student has enough Cash ($%lld)\n", bal);
+            else printf("Dear old Dad: Thinks Student %d has enough Cash ($%lld)\n", st, bal);
+            break;
+        case EV_BALANCE:
+            if (st < 0) printf("Dear Old Dad: Last Checking Balance = $%lld\n", bal);
+            else printf("Dear Old Dad: Last Checking Balance of Student %d = $%lld\n", st, bal);
+            break;
+        }
+        break;
+    case ROLE_MOM:
+        switch (e->op) {
+        case EV_ATTEMPT: printf("Loveable Mom: Attempting to Check Balance\n"); break;
+        case EV_DEPOSIT:
+            if (st < 0) printf("Lovable Mom: Deposits $%d / Balance = $%lld\n", a, bal);
+            else printf("Lovable Mom: Deposits $%d for Student %d / Balance = $%lld\n", a, st, bal);
+            break;
+        }
+        break;
+    case ROLE_STUDENT:
+        switch (e->op) {
+        case EV_ATTEMPT: printf("Poor Student: Attempting to Check Balance\n"); break;
+        case EV_NEEDS:
+            if (st < 0) printf("Poor Student needs $%d\n", a);
+            else printf("Poor Student %d needs $%d\n", st, a);
+            break;
+        case EV_WITHDRAW:
+            if (st < 0) printf("Poor Student: Withdraws $%d / Balance = $%lld\n", a, bal);
+            else printf("Poor Student %d: Withdraws $%d / Balance = $%lld\n", st, a, bal);
+            break;
+        case EV_SHORT:
+            if (st < 0) printf("Poor Student: Not Enough Cash ($%lld)\n", bal);
+            else printf("Poor Student %d: Not Enough Cash ($%lld)\n", st, bal);
+            break;
+        case EV_BALANCE:
+            if (st < 0) printf("Poor Student: Last Checking Balance = $%lld\n", bal);
+            else printf("Poor Student %d: Last Checking Balance = $%lld\n", st, bal);
+            break;
+        case EV_BORROW:
+            printf("Poor Student %d: Borrows $%d from Student %d ($%lld left)\n", st, a, e->other, bal);
+            break;
+        }
+        break;
+    }
+}
+
+/* ------- nanosleep helpers ------- */
+static void sleep_ms(long ms) {
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000L;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+static void sleep_us(long us) {
+    struct timespec ts;
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000L;
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+}
+
+/* ------- RNG ------- */
+// Role i draws from stream i of rng_seed (rng.h), in a generator of its
+// own thread. rng_seed is picked once, before the forks, unless --seed
+// gives it; either way it is printed so a run can be repeated.
+static uint64_t rng_seed = 0;
+static _Thread_local Rng rng;
+
+static void seed_rng(int role) {
+    RngSeed(&rng, rng_seed, (uint64_t)role);
+}
+static int randi(int lo, int hi) {  // inclusive
+    return RngRange(&rng, lo, hi);
+}
+
+/* ------- role pacing: forever with random sleeps, or --bench ------- */
+static void bench_claim(int slot, const char *role) {
+    if (!bench) return;
+    my_slot = &bench_slots[slot];
+    snprintf(my_slot->role, sizeof(my_slot->role), "%s", role);
+    my_slot->pid = (int)getpid();
+}
+
+/* true while the role should keep going; under --bench, also times the op just done */
+static bool next_op(void) {
+    if (!bench) return true;
+    uint64_t now = BenchNow();
+    if (my_slot->begin == 0) {
+        my_slot->begin = now;
+    } else {
+        HistogramRecord(&my_slot->op, now - op_start);
+        my_slot->ops++;
+    }
+    my_slot->end = now;
+    return my_slot->ops < (uint64_t)bench_ops;
+}
+
+/* the pause before each operation */
+static void think(int lo_s, int hi_s) {
+    if (!bench) {
+        sleep_ms(randi(lo_s, hi_s) * 1000L);
+        return;
+    }
+    if (think_us > 0) sleep_us(think_us);
+    op_start = BenchNow();
+}
+
+/* ------- the balance: seqlock-published writes, lock-free reads ------- */
+/* caller holds the account lock */
+static void commit_balance_raw(int balance) {
+    SeqlockWriteBegin(&S->balance_seq);
+    __atomic_store_n(&S->BankAccount, balance, __ATOMIC_RELAXED);
+    SeqlockWriteEnd(&S->balance_seq);
+}
+
+/* does this turn only check the balance? (read_pct of the time) */
+static bool check_only(void) {
+    return randi(0, 99) < read_pct;
+}
+
+/* ------- account lock ------- */
+static void lock_account(void) {
+    uint64_t t0 = bench ? BenchNow() : 0;
+    if (backend->acquire()) {
+        say("[%d] Previous lock holder died; balance may be stale\n", (int)getpid());
+        SeqlockRepair(&S->balance_seq);
+        /* it may have journaled a change without applying it */
+        if (use_journal) commit_balance_raw((int)JournalBalance(&journal));
+    }
+    if (dies_holding) kill(getpid(), SIGKILL);
+    if (bench) {
+        lock_taken = BenchNow();
+        HistogramRecord(&my_slot->wait, lock_taken - t0);
+    }
+}
+
+static void unlock_account(void) {
+    if (bench) HistogramRecord(&my_slot->hold, BenchNow() - lock_taken);
+    backend->release();
+}
+
+/* write-ahead: journal the change, then apply it; caller holds the lock */
+static void commit_balance(int delta, int balance) {
+    if (use_journal) JournalAppend(&journal, delta, balance);
+    commit_balance_raw(balance);
+}
+
+/* a consistent balance without the lock; falls back to it if writes keep interfering */
+static int read_balance(void) {
+    if (!locked_reads) {
+        for (int tries = 0; tries < SEQLOCK_READ_TRIES; tries++) {
+            unsigned start;
+            if (SeqlockReadBegin(&S->balance_seq, &start)) {
+                int balance = __atomic_load_n(&S->BankAccount, __ATOMIC_RELAXED);
+                if (SeqlockReadValid(&S->balance_seq, start)) return balance;
+            }
+            sched_yield();
+        }
+    }
+    lock_account();
+    int balance = S->BankAccount;
+    unlock_account();
+    return balance;
+}
+
+/* what a check turn reports and a parent decides on; student is -1 unless --lock ledger */
+static long long peek_balance(int student) {
+    switch (backend->model) {
+    case MODEL_ATOMIC: return atomic_load(&S->AtomicBankAccount);
+    case MODEL_LEDGER: return LedgerBalance(S->accounts, student);
+    default:           return read_balance();
+    }
+}
+
+/* ------- roles ------- */
+// A role is a row of roles[]: how long it thinks between turns, how much
+// money it moves, and whether it gives or takes. Each lock model has one
+// give and one take turn; the parents share the give turn.
+typedef struct RoleSpec RoleSpec;
+typedef void (*TurnFn)(const RoleSpec *r, int student);
+
+struct RoleSpec {
+    int role;               // ROLE_* in the event log
+    const char *name;       // --bench label
+    int think_lo_s;         // pause before each turn, in seconds
+    int think_hi_s;
+    int max_amount;         // each deposit or withdrawal is 0..max_amount
+    int gives_below;        // parents only deposit while the balance is below this
+    bool gives;             // deposits (parents) or withdraws (students)
+    bool check_turns;       // read_pct of turns only check the balance
+    bool says_enough;       // parents: report a balance that is already enough
+    bool even_only;         // parents: an odd draw means no money to give
+};
+
+static const RoleSpec roles[] = {
+    [ROLE_DAD] = { .role = ROLE_DAD, .name = "Dad", .think_lo_s = 0, .think_hi_s = 5,
+                   .max_amount = 100, .gives_below = 100, .gives = true,
+                   .check_turns = true, .says_enough = true, .even_only = true },
+    [ROLE_MOM] = { .role = ROLE_MOM, .name = "Mom", .think_lo_s = 0, .think_hi_s = 10,
+                   .max_amount = 125, .gives_below = 101, .gives = true },
+    [ROLE_STUDENT] = { .role = ROLE_STUDENT, .name = "Student", .think_lo_s = 0, .think_hi_s = 5,
+                       .max_amount = 50, .check_turns = true },
+};
+
+/* the one balance under the lock */
+static void give_locked(const RoleSpec *r, int student) {
+    (void)student;
+    /* nothing to do when there's enough, and seeing that needs no lock */
+    long long seen = read_balance();
+    if (seen >= r->gives_below) {
+        if (r->says_enough) log_event(r->role, EV_ENOUGH, -1, 0, seen, -1);
+        return;
+    }
+
+    lock_account();
+    int localBalance = S->BankAccount;
+    if (localBalance < r->gives_below) {
+        int amount = randi(0, r->max_amount);
+        if (r->even_only && (amount % 2) != 0) {
+            log_event(r->role, EV_NO_MONEY, -1, 0, 0, -1);
+        } else {
+            localBalance += amount;
+            log_event(r->role, EV_DEPOSIT, -1, amount, localBalance, -1);
+            commit_balance(amount, localBalance);
+        }
+    } else if (r->says_enough) {
+        log_event(r->role, EV_ENOUGH, -1, 0, localBalance, -1);
+    }
+    unlock_account();
+}
+
+static void take_locked(const RoleSpec *r, int student) {
+    (void)student;
+    lock_account();
+    int localBalance = S->BankAccount;
+
+    int need = randi(0, r->max_amount);
+    log_event(r->role, EV_NEEDS, -1, need, 0, -1);
+    if (need <= localBalance) {
+        localBalance -= need;
+        log_event(r->role, EV_WITHDRAW, -1, need, localBalance, -1);
+        commit_balance(-need, localBalance);
+    } else {
+        log_event(r->role, EV_SHORT, -1, 0, localBalance, -1);
+    }
+    unlock_account();
+}
+
+// --lock atomic and --lock ledger: a decision is made on a snapshot of
+// the balance, so e.g. Dad may top up an account that has just gone over
+// $100; the balance itself never loses an update or goes negative.
+static void give_unlocked(const RoleSpec *r, int student) {
+    long long localBalance = peek_balance(student);
+    if (localBalance >= r->gives_below) {
+        if (r->says_enough) log_event(r->role, EV_ENOUGH, student, 0, localBalance, -1);
+        return;
+    }
+
+    int amount = randi(0, r->max_amount);
+    if (r->even_only && (amount % 2) != 0) {
+        log_event(r->role, EV_NO_MONEY, -1, 0, 0, -1);
+        return;
+    }
+    if (backend->model == MODEL_ATOMIC) {
+        localBalance = atomic_fetch_add(&S->AtomicBankAccount, amount) + amount;
+    } else {
+        localBalance = LedgerDeposit(S->accounts, student, amount);
+    }
+    log_event(r->role, EV_DEPOSIT, student, amount, localBalance, -1);
+}
+
+static void take_atomic(const RoleSpec *r, int student) {
+    (void)student;
+    long long localBalance = atomic_load(&S->AtomicBankAccount);
+
+    int need = randi(0, r->max_amount);
+    log_event(r->role, EV_NEEDS, -1, need, 0, -1);
+    // only take the money if it is still there when we swap
+    while (need <= localBalance &&
+           !atomic_compare_exchange_weak(&S->AtomicBankAccount, &localBalance,
+                                         localBalance - need)) {
+    }
+    if (need <= localBalance) {
+        log_event(r->role, EV_WITHDRAW, -1, need, localBalance - need, -1);
+    } else {
+        log_event(r->role, EV_SHORT, -1, 0, localBalance, -1);
+    }
+}
+
+/* a student who is short borrows the difference from a sibling with an atomic transfer */
+static void take_ledger(const RoleSpec *r, int idx) {
+    int need = randi(0, r->max_amount);
+    log_event(r->role, EV_NEEDS, idx, need, 0, -1);
+
+    int64_t localBalance;
+    bool ok = LedgerWithdraw(S->accounts, idx, need, &localBalance);
+    if (!ok && S->num_accounts > 1) {
+        int sibling = (idx + randi(1, S->num_accounts - 1)) % S->num_accounts;
+        int64_t shortfall = need - localBalance, siblingBalance;
+        if (LedgerTransfer(S->accounts, sibling, idx, shortfall, &siblingBalance, &localBalance)) {
+            log_event(r->role, EV_BORROW, idx, (int)shortfall, siblingBalance, sibling);
+            ok = LedgerWithdraw(S->accounts, idx, need, &localBalance);
+        }
+    }
+    if (ok) {
+        log_event(r->role, EV_WITHDRAW, idx, need, localBalance, -1);
+    } else {
+        log_event(r->role, EV_SHORT, idx, 0, localBalance, -1);
+    }
+}
+
+static const struct { TurnFn give, take; } turns[MODEL_COUNT] = {
+    [MODEL_LOCKED] = { give_locked,   take_locked },
+    [MODEL_ATOMIC] = { give_unlocked, take_atomic },
+    [MODEL_LEDGER] = { give_unlocked, take_ledger },
+};
+
+/* idx is the student's own account under --lock ledger */
+static void role_loop(const RoleSpec *r, int idx) {
+    TurnFn turn = r->gives ? turns[backend->model].give : turns[backend->model].take;
+    while (next_op()) {
+        think(r->think_lo_s, r->think_hi_s);
+        log_event(r->role, EV_ATTEMPT, -1, 0, 0, -1);
+
+        /* with a ledger, parents fund one random student per turn */
+        int student = -1;
+        if (backend->model == MODEL_LEDGER) student = r->gives ? randi(0, S->num_accounts - 1) : idx;
+
+        if (r->check_turns && check_only()) {
+            log_event(r->role, EV_BALANCE, student, 0, peek_balance(student), -1);
+            continue;
+        }
+        turn(r, student);
+    }
+}
+
+/* ------- workers: a process per role, or processes of role threads ------- */
+/* role i: Dad, then Mom if asked for, then the students */
+static void run_role(int i) {
+    const RoleSpec *r = &roles[ROLE_STUDENT];
+    int student = i - num_parents;
+    if (i == 0) r = &roles[ROLE_DAD];
+    else if (i < num_parents) r = &roles[ROLE_MOM];
+
+    char label[24];
+    if (r->gives) snprintf(label, sizeof(label), "%s", r->name);
+    else snprintf(label, sizeof(label), "%s %d", r->name, student);
+    bench_claim(i, label);
+    seed_rng(i);
+    dies_holding = kill_holder && i == role_count - 1;
+    role_loop(r, student);
+}
+
+static void *role_thread(void *arg) {
+    run_role((int)(intptr_t)arg);
+    return NULL;
+}
+
+/* worker w runs roles w, w + child_count, ...; returns when they are all done */
+static void run_worker(int w) {
+    if (!use_threads) {
+        run_role(w);
+        return;
+    }
+    int n = (role_count - w + child_count - 1) / child_count;
+    pthread_t *threads = calloc(n, sizeof(pthread_t));
+    if (!threads) { perror("calloc"); _exit(1); }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, ROLE_THREAD_STACK);
+    for (int t = 0; t < n; t++) {
+        int err = pthread_create(&threads[t], &attr, role_thread, (void *)(intptr_t)(w + t * child_count));
+        if (err != 0) { fprintf(stderr, "pthread_create: %s\n", strerror(err)); _exit(1); }
+    }
+    pthread_attr_destroy(&attr);
+    for (int t = 0; t < n; t++) pthread_join(threads[t], NULL);
+    free(threads);
+}
+
+/* ------- journal group commit (a thread in the parent) ------- */
+static void *journal_syncer(void *arg) {
+    (void)arg;
+    for (;;) {
+        sleep_ms(sync_ms);
+        JournalSync(&journal);
+    }
+    return NULL;
+}
+
+/**
+ * --replay-check: rebuilds the balance from bank.wal and checks it against
+ * what bank.mem says, after a --provider file run that may have been
+ * killed at any point. A process killed between journaling and applying
+ * its change leaves bank.mem one operation behind, which is allowed.
+ */
+static int replay_check(void) {
+    int fd = open(SHM_FILE, O_RDWR);
+    if (fd < 0) { perror("open " SHM_FILE); return 1; }
+    Shared *mem = mmap(NULL, sizeof(Shared), PROT_READ, MAP_SHARED, fd, 0);
+    if (mem == MAP_FAILED) { perror("mmap"); close(fd); return 1; }
+
+    uint64_t replayed;
+    if (!JournalOpen(&journal, JOURNAL_FILE, &replayed)) { perror("open " JOURNAL_FILE); return 1; }
+    JournalHeader *h = journal.h;
+    const JournalCheckpoint *c = &h->ckpt[h->cur];
+
+    int negative = 0;
+    for (uint64_t i = 0; i < replayed; i++) {
+        if (journal.records[i].balance < 0) negative++;
+    }
+    long long replay = (long long)JournalBalance(&journal);
+    long long live = mem->BankAccount;
+    long long last_delta = replayed > 0 ? journal.records[replayed - 1].delta : 0;
+    bool ok = negative == 0 && (live == replay || live == replay - last_delta);
+
+    printf("replay: checkpoint $%lld at op %llu + %llu records = $%lld; bank.mem = $%lld; %s\n",
+           (long long)c->balance, (unsigned long long)c->lsn, (unsigned long long)replayed,
+           replay, live, ok ? "OK" : negative ? "FAIL (balance went negative)" : "FAIL");
+    munmap(mem, sizeof(Shared));
+    close(fd);
+    JournalClose(&journal);
+    return ok ? 0 : 1;
+}
+
+/* ------- cleanup ------- */
+static void cleanup(void) {
+    if (backend && backend->close) backend->close();
+    if (region) {
+        provider->unmap(region, region_size);
+        region = NULL;
+        S = NULL;
+        events = NULL;
+        bench_slots = NULL;
+    }
+    /* the journal stays mapped: the syncer may still be running, and
+     * the process exits right after cleanup anyway */
+    if (journal.h) JournalSync(&journal);
+}
+
+/* ------- signal handling in parent ------- */
+static void on_sigint(int signo) {
+    (void)signo;
+    if (shutting_down) return;
+    shutting_down = 1;
+
+    say("\n[Parent] SIGINT — terminating children and cleaning up...\n");
+    for (int i = 0; i < child_count; i++) {
+        if (child_pids[i] > 0) kill(child_pids[i], SIGTERM);
+    }
+
+    // Reap children
+    for (int i = 0; i < child_count; i++) {
+        if (child_pids[i] > 0) {
+            int st = 0;
+            (void)waitpid(child_pids[i], &st, 0);
+        }
+    }
+
+    cleanup();
+    _exit(0);
+}
+
+/* ------- parent SIGCHLD -> reap -------
+ * A child that dies stays a zombie until reaped, and kill(pid, 0) still
+ * finds a zombie: a lock it held (bank_lock.h) or a record it was writing
+ * (event_log.h) would never be recovered. So reap each child as it goes,
+ * whatever the parent is busy with. */
+static void on_sigchld(int signo) {
+    (void)signo;
+    int saved_errno = errno;
+    pid_t p;
+    while ((p = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int i = 0; i < child_count; i++) {
+            if (child_pids[i] == p) child_pids[i] = 0;
+        }
+    }
+    errno = saved_errno;
+}
+
+/* ------- child SIGTERM -> exit quickly ------- */
+static void child_term(int signo) {
+    (void)signo;
+    _exit(0);
+}
+
+/* ------- main ------- */
+static const Provider *find_provider(const char *name) {
+    for (size_t i = 0; i < sizeof(providers) / sizeof(providers[0]); i++) {
+        if (strcmp(providers[i].name, name) == 0) return &providers[i];
+    }
+    return NULL;
+}
+
+static const LockBackend *find_backend(const char *name) {
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i].name, name) == 0) return &backends[i];
+    }
+    return NULL;
+}
+
+int BankMain(int argc, char **argv, const BankDefaults *defaults) {
+    num_parents = defaults->num_parents;
+    int num_children = defaults->num_children;
+    const char *provider_name = defaults->provider;
+    const char *lock_name = defaults->lock;
+    int lock_flags = 0;
+    bool seeded = false;
+
+    /* flags may come anywhere; what's left are the two counts */
+    char *counts[2];
+    int ncounts = 0;
+    bool bad_flag = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--provider") == 0 && i + 1 < argc) provider_name = argv[++i];
+        else if (strcmp(argv[i], "--lock") == 0 && i + 1 < argc) { lock_name = argv[++i]; lock_flags++; }
+        else if (strcmp(argv[i], "--atomic") == 0 || strcmp(argv[i], "--sem") == 0 ||
+                 strcmp(argv[i], "--ledger") == 0) { lock_name = argv[i] + 2; lock_flags++; }
+        else if (strcmp(argv[i], "--threads") == 0) use_threads = true;
+        else if (strcmp(argv[i], "--procs") == 0 && i + 1 < argc) { num_procs = atoi(argv[++i]); use_threads = true; }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) { rng_seed = strtoull(argv[++i], NULL, 0); seeded = true; }
+        else if (strcmp(argv[i], "--locked-reads") == 0) locked_reads = true;
+        else if (strcmp(argv[i], "--read-pct") == 0 && i + 1 < argc) read_pct = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--journal") == 0) use_journal = true;
+        else if (strcmp(argv[i], "--sync-ms") == 0 && i + 1 < argc) { sync_ms = atol(argv[++i]); use_journal = true; }
+        else if (strcmp(argv[i], "--replay-check") == 0) return replay_check();
+        else if (strcmp(argv[i], "--bench") == 0) bench = true;
+        else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) { bench_ops = atol(argv[++i]); bench = true; }
+        else if (strcmp(argv[i], "--think-us") == 0 && i + 1 < argc) { think_us = atol(argv[++i]); bench = true; }
+        else if (strcmp(argv[i], "--kill-holder") == 0) kill_holder = true;
+        else if (strncmp(argv[i], "--", 2) == 0) bad_flag = true;
+        else if (defaults->take_counts && ncounts < 2) counts[ncounts++] = argv[i];
+        else bad_flag = true;
+    }
+
+    provider = find_provider(provider_name);
+    backend = find_backend(lock_name);
+    /* the backends replace each other's locking; pick one */
+    if (!provider || !backend || lock_flags > 1) bad_flag = true;
+    if (bench_ops < 1 || think_us < 0 || read_pct < 0 || read_pct > 100 || num_procs < 1) bad_flag = true;
+    /* a process-private lock needs every role in one process */
+    if (backend && backend->process_private && (!use_threads || num_procs != 1)) bad_flag = true;
+    /* the journal follows the one locked balance */
+    if (use_journal && (!backend || backend->model != MODEL_LOCKED || sync_ms < 1)) bad_flag = true;
+
+    if (!bad_flag && (ncounts == 2 || !defaults->take_counts)) {
+        if (ncounts == 2) {
+            num_parents = atoi(counts[0]);
+            num_children = atoi(counts[1]);
+        }
+    } else if (argc > 1) {
+        fprintf(stderr, "Usage: %s [--provider file|posix|sysv|anon] "
+                        "[--lock futex|sem|atomic|ledger|futex-private|mutex] [--threads | --procs M] [--seed N] "
+                        "[--journal [--sync-ms N]] [--locked-reads] [--read-pct N] "
+                        "[--bench [--ops N] [--think-us N]] [--kill-holder]%s\n"
+                        "       %s --replay-check\n", argv[0],
+                defaults->take_counts ? " <num_parents{1|2}> <num_children>=1..N" : "", argv[0]);
+        fprintf(stderr, "Defaulting to: %s + %d Student%s\n", num_parents == 2 ? "Dad + Mom" : "Dad only",
+                num_children, num_children == 1 ? "" : "s");
+    }
+    if (num_parents < 1) num_parents = 1;
+    if (num_parents > 2) num_parents = 2;
+    if (num_children < 1) num_children = 1;
+    if (bad_flag) {
+        provider = find_provider(defaults->provider);
+        backend = find_backend(defaults->lock);
+        use_journal = locked_reads = bench = use_threads = kill_holder = false;
+        read_pct = 50;
+        num_procs = 1;
+    }
+    if (!provider || !backend) {
+        fprintf(stderr, "%s: unknown default provider or lock\n", argv[0]);
+        return 1;
+    }
+
+    if (!seeded || bad_flag) rng_seed = RngDefaultSeed();
+    role_count = num_parents + num_children;
+    child_count = !use_threads ? role_count : num_procs < role_count ? num_procs : role_count;
+
+    /* one region from the provider: Shared, the event ring, the bench slots */
+    int num_accounts = backend->model == MODEL_LEDGER ? num_children : 0;
+    size_t events_off = REGION_ALIGN(sizeof(Shared) + (size_t)num_accounts * sizeof(Account));
+    size_t slots_off = events_off + REGION_ALIGN(sizeof(EventLog));
+    region_size = slots_off + (bench ? (size_t)role_count * sizeof(BenchSlot) : 0);
+    region = provider->map(region_size);
+    if (!region) return 1;
+    S = region;
+    events = (EventLog *)((char *)region + events_off);
+
+    S->BankAccount = 0;
+    SeqlockInit(&S->balance_seq);
+    atomic_store(&S->AtomicBankAccount, 0);
+    BankLockInit(&S->lock);
+    S->num_accounts = num_accounts;
+    LedgerInit(S->accounts, S->num_accounts);
+    EventLogInit(events);  // unused under --bench
+    if (bench) {
+        bench_slots = (BenchSlot *)((char *)region + slots_off);
+        memset(bench_slots, 0, (size_t)role_count * sizeof(BenchSlot));
+    }
+
+    /* with a journal, the balance survives from the last run */
+    if (use_journal) {
+        uint64_t replayed;
+        if (!JournalOpen(&journal, JOURNAL_FILE, &replayed)) { perror("open " JOURNAL_FILE); cleanup(); return 1; }
+        S->BankAccount = (int)JournalBalance(&journal);
+        fprintf(stderr, "Recovered balance $%d (checkpoint at op %llu + %llu journal records)\n",
+                S->BankAccount, (unsigned long long)journal.h->ckpt[journal.h->cur].lsn,
+                (unsigned long long)replayed);
+    }
+
+    if (backend->open && !backend->open()) { cleanup(); return 1; }
+
+    /* every worker is a child; the parent only supervises */
+    child_pids = calloc(child_count, sizeof(pid_t));
+    if (!child_pids) { perror("calloc"); cleanup(); return 1; }
+
+    /* parent SIGINT -> cleanup (reaping itself); SIGCHLD -> reap */
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaddset(&sa.sa_mask, SIGCHLD);
+    sigaction(SIGINT, &sa, NULL);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigchld;
+    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &sa, NULL);
+
+    /* no reaping until child_pids has the child's pid */
+    sigset_t chld, unblocked;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &unblocked);
+    for (int i = 0; i < child_count; i++) {
+        pid_t p = fork();
+        if (p < 0) { perror("fork"); on_sigint(SIGINT); }
+        if (p == 0) {
+            signal(SIGINT, SIG_IGN);
+            signal(SIGTERM, child_term);
+            signal(SIGCHLD, SIG_DFL);
+            sigprocmask(SIG_SETMASK, &unblocked, NULL);
+            run_worker(i);
+            _exit(0);
+        }
+        child_pids[i] = p;
+    }
+    sigprocmask(SIG_SETMASK, &unblocked, NULL);
+
+    /* group commit: started after the forks so no child inherits it, and
+     * with signals blocked so Ctrl-C always lands on the main thread */
+    if (use_journal) {
+        sigset_t all, old;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &old);
+        pthread_t syncer;
+        int err = pthread_create(&syncer, NULL, journal_syncer, NULL);
+        pthread_sigmask(SIG_SETMASK, &old, NULL);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create failed\n");
+            on_sigint(SIGINT);
+        }
+        pthread_detach(syncer);
+    }
+
+    char topology[48];
+    if (use_threads) snprintf(topology, sizeof(topology), "%d proc%s of threads", child_count, child_count == 1 ? "" : "s");
+    else snprintf(topology, sizeof(topology), "a proc per role");
+
+    if (bench) {
+        /* every child stops after bench_ops; then report. on_sigchld may
+         * reap one first (then waitpid fails with ECHILD) */
+        for (int i = 0; i < child_count; i++) {
+            pid_t p = child_pids[i];
+            int st = 0;
+            while (p > 0 && waitpid(p, &st, 0) < 0 && errno == EINTR) {}
+            child_pids[i] = 0;
+        }
+        char label[224];
+        snprintf(label, sizeof(label), "%s lock, %s memory%s%s, %s, %d%% reads, %ld ops each, think %ld us, seed %llu",
+                 backend->name, provider->name, use_journal ? " + journal" : "",
+                 locked_reads ? ", locked reads" : "", topology, read_pct, bench_ops, think_us,
+                 (unsigned long long)rng_seed);
+        BenchReport(bench_slots, role_count, label);
+        cleanup();
+        return 0;
+    }
+
+    /* Parent is the logger; Ctrl-C cleans up */
+    say("Started: %s (parents=%d, students=%d, %s lock, %s memory, %s%s, seed %llu)\n", argv[0],
+        num_parents, num_children, backend->name, provider->name, topology,
+        use_journal ? ", journaled" : "", (unsigned long long)rng_seed);
+    while (1) {
+        if (EventLogDrain(events, print_event) > 0) fflush(stdout);
+        EventLogWait(events, 1000);
+    }
+
+    // not reached
+    cleanup();
+    return 0;
+}
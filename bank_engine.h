@@ -0,0 +1,33 @@
+// bank_engine.h — the bank simulation behind psdd, psdd_ec, shm_proc and bank_sim.
+//
+// The roles, event log, --bench, --journal and cleanup live once, in
+// bank_engine.c. Two things are pluggable:
+//  - the provider of the shared memory every process maps
+//    (--provider file|posix|sysv|anon);
+//  - the lock backend that guards the balance
+//    (--lock futex|sem|atomic|ledger, or futex-private|mutex under --threads).
+// Each role is a process of its own, unless --threads (or --procs M)
+// makes them threads of one (or M) worker processes.
+// Each program is a main() that picks its defaults and calls BankMain().
+
+#ifndef LAB3_BANK_ENGINE_H_
+#define LAB3_BANK_ENGINE_H_
+
+#include <stdbool.h>
+
+typedef struct {
+    const char *provider;   // shared memory, unless --provider says otherwise
+    const char *lock;       // lock backend, unless --lock says otherwise
+    int num_parents;        // 1 = Dad only, 2 = Dad + Mom
+    int num_children;       // Poor Students
+    bool take_counts;       // accept <num_parents> <num_children> on the command line
+} BankDefaults;
+
+/**
+ * Parses the command line, sets up the shared state and runs the roles
+ * until Ctrl-C (or, under --bench, until every role is done).
+ * Returns the process exit status.
+ */
+int BankMain(int argc, char **argv, const BankDefaults *defaults);
+
+#endif  // LAB3_BANK_ENGINE_H_
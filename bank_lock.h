@@ -0,0 +1,151 @@
+// bank_lock.h — a process-shared mutex that lives inside the shared segment.
+//
+// Used by the bank engine (--lock futex) in place of a named POSIX semaphore:
+// nothing is created under /dev/shm, so nothing is left behind by a crash.
+//
+// The lock is one 32-bit word: the owner's pid (0 = free) plus a bit saying
+// someone may be asleep on it. Taking a free lock is a single CAS and
+// releasing an uncontended one a single exchange; only contended lock and
+// unlock enter the kernel (FUTEX_WAIT / FUTEX_WAKE on the shared word).
+//
+// BankLockAcquirePrivate() / BankLockReleasePrivate() are the same lock for
+// when every user is a thread of one process: the futex calls pass
+// FUTEX_PRIVATE_FLAG, which lets the kernel skip the shared-mapping lookup.
+// A lock must be used through one pair or the other, never both.
+// Threads of one process share an owner id (the pid); that is fine, as
+// only dead-owner recovery reads it, and a thread can't die on its own.
+//
+// Robustness: a waiter that has slept BANK_LOCK_CHECK_MS without getting
+// the lock checks that the owner still exists (kill(pid, 0)). If it died
+// holding the lock, the waiter takes it over and BankLockAcquire() returns
+// true: whatever the lock guards may be half-updated. (If the dead owner's
+// pid has already been reused, recovery waits until that process exits.)
+// A dead owner only stops existing once it is reaped: an unreaped zombie
+// still answers kill(). Whoever forks the users must reap them as they
+// exit (bank_engine.c does it on SIGCHLD), or recovery never happens.
+//
+// Needs _DEFAULT_SOURCE (or _GNU_SOURCE) for syscall().
+
+#ifndef LAB3_BANK_LOCK_H_
+#define LAB3_BANK_LOCK_H_
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#define BANK_LOCK_WAITERS  0x80000000u
+#define BANK_LOCK_CHECK_MS 100
+
+typedef struct {
+    atomic_uint word;
+} BankLock;
+
+static inline void BankLockInit(BankLock *l) {
+    atomic_store(&l->word, 0);
+}
+
+/* ----- owner id: our pid, cached, and forgotten again in a forked child -----
+   (bank_engine.c owns the cache, so every includer shares one) */
+extern pid_t bank_lock_pid;
+void BankLockCachePid(void);
+
+static inline unsigned BankLockSelf(void) {
+    if (bank_lock_pid == 0) BankLockCachePid();
+    return (unsigned)bank_lock_pid;
+}
+
+/* true if pid no longer exists (EPERM means it does, we just can't signal it;
+   a zombie does too, until its parent reaps it) */
+static inline bool BankLockOwnerDead(unsigned pid) {
+    return pid != 0 && kill((pid_t)pid, 0) == -1 && errno == ESRCH;
+}
+
+/* priv is FUTEX_PRIVATE_FLAG or 0 */
+static inline bool BankLockAcquireSlow(BankLock *l, unsigned self, int priv) {
+    for (;;) {
+        unsigned v = atomic_load_explicit(&l->word, memory_order_relaxed);
+        if (v == 0) {
+            /* others may still be asleep, so keep the waiters bit set */
+            if (atomic_compare_exchange_weak_explicit(&l->word, &v, self | BANK_LOCK_WAITERS,
+                                                      memory_order_acquire,
+                                                      memory_order_relaxed)) {
+                return false;
+            }
+            continue;
+        }
+        if (!(v & BANK_LOCK_WAITERS)) {
+            if (!atomic_compare_exchange_weak_explicit(&l->word, &v, v | BANK_LOCK_WAITERS,
+                                                       memory_order_relaxed,
+                                                       memory_order_relaxed)) {
+                continue;
+            }
+            v |= BANK_LOCK_WAITERS;
+        }
+
+        struct timespec timeout = { 0, BANK_LOCK_CHECK_MS * 1000000L };
+        int saved_errno = errno;
+        long r = syscall(SYS_futex, &l->word, FUTEX_WAIT | priv, v, &timeout, NULL, 0);
+        bool timed_out = r == -1 && errno == ETIMEDOUT;
+        errno = saved_errno;
+
+        if (timed_out && BankLockOwnerDead(v & ~BANK_LOCK_WAITERS)) {
+            /* only one waiter wins the takeover; the rest see a new owner */
+            if (atomic_compare_exchange_strong_explicit(&l->word, &v, self | BANK_LOCK_WAITERS,
+                                                        memory_order_acquire,
+                                                        memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+}
+
+static inline bool BankLockAcquireFlags(BankLock *l, int priv) {
+    unsigned self = BankLockSelf();
+    unsigned expected = 0;
+    if (atomic_compare_exchange_strong_explicit(&l->word, &expected, self,
+                                                memory_order_acquire,
+                                                memory_order_relaxed)) {
+        return false;
+    }
+    return BankLockAcquireSlow(l, self, priv);
+}
+
+static inline void BankLockReleaseFlags(BankLock *l, int priv) {
+    unsigned old = atomic_exchange_explicit(&l->word, 0, memory_order_release);
+    if (old & BANK_LOCK_WAITERS) {
+        syscall(SYS_futex, &l->word, FUTEX_WAKE | priv, 1, NULL, NULL, 0);
+    }
+}
+
+/**
+ * Takes the lock, sleeping while another process holds it.
+ * Returns true if it was taken over from an owner that died holding it.
+ */
+static inline bool BankLockAcquire(BankLock *l) {
+    return BankLockAcquireFlags(l, 0);
+}
+
+/**
+ * Releases the lock; wakes one sleeper if anyone might be asleep.
+ */
+static inline void BankLockRelease(BankLock *l) {
+    BankLockReleaseFlags(l, 0);
+}
+
+/* the same, for a lock only the threads of one process use */
+static inline bool BankLockAcquirePrivate(BankLock *l) {
+    return BankLockAcquireFlags(l, FUTEX_PRIVATE_FLAG);
+}
+
+static inline void BankLockReleasePrivate(BankLock *l) {
+    BankLockReleaseFlags(l, FUTEX_PRIVATE_FLAG);
+}
+
+#endif  // LAB3_BANK_LOCK_H_
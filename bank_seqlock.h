@@ -0,0 +1,59 @@
+// bank_seqlock.h — lock-free balance reads for the bank engine.
+//
+// Writers still serialize on the account lock, and additionally bump a
+// sequence counter around each change: odd while the change is under way,
+// even again once it is done. A reader never writes shared memory. It
+// reads the counter, then the data, then the counter again, and retries
+// if the counter was odd or moved.
+//
+// A writer that dies mid-change leaves the counter odd. A reader that keeps
+// failing gives up after SEQLOCK_READ_TRIES and takes the account lock
+// instead; taking over a dead owner's lock calls SeqlockRepair().
+
+#ifndef LAB3_BANK_SEQLOCK_H_
+#define LAB3_BANK_SEQLOCK_H_
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define SEQLOCK_READ_TRIES 64
+
+typedef struct {
+    atomic_uint seq;
+} Seqlock;
+
+static inline void SeqlockInit(Seqlock *s) {
+    atomic_store(&s->seq, 0);
+}
+
+/* writer, with the account lock held */
+static inline void SeqlockWriteBegin(Seqlock *s) {
+    atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static inline void SeqlockWriteEnd(Seqlock *s) {
+    atomic_store_explicit(&s->seq, atomic_load_explicit(&s->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+/* after taking the lock over from a writer that died between Begin and End */
+static inline void SeqlockRepair(Seqlock *s) {
+    if (atomic_load_explicit(&s->seq, memory_order_relaxed) & 1) SeqlockWriteEnd(s);
+}
+
+/* reader: returns false while a write is in progress */
+static inline bool SeqlockReadBegin(const Seqlock *s, unsigned *start) {
+    *start = atomic_load_explicit((atomic_uint *)&s->seq, memory_order_acquire);
+    return (*start & 1) == 0;
+}
+
+/* reader: true if what was read since SeqlockReadBegin is a consistent snapshot */
+static inline bool SeqlockReadValid(const Seqlock *s, unsigned start) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit((atomic_uint *)&s->seq, memory_order_relaxed) == start;
+}
+
+#endif  // LAB3_BANK_SEQLOCK_H_
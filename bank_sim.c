@@ -0,0 +1,23 @@
+// bank_sim.c — the bank simulation over an anonymous shared mapping.
+//
+// Same roles and flags as psdd_ec (see bank_engine.c), but nothing is left
+// behind in the filesystem by default; meant for comparing providers and
+// lock backends under one workload:
+//   ./bank_sim --bench --provider posix --lock sem 2 64
+//   make bench-ipc
+//
+// Build: make bank_sim
+// Stop:  Ctrl-C
+
+#include "bank_engine.h"
+
+int main(int argc, char **argv) {
+    static const BankDefaults defaults = {
+        .provider = "anon",
+        .lock = "futex",
+        .num_parents = 1,
+        .num_children = 1,
+        .take_counts = true,
+    };
+    return BankMain(argc, argv, &defaults);
+}
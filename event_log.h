@@ -0,0 +1,212 @@
+// event_log.h — a lock-free multi-producer ring of fixed-size event records.
+//
+// Used by the bank engine (bank_engine.c) so the role loops never print
+// while holding the account lock: a role appends a binary EventRecord (a
+// few stores and one atomic add), and a single logger drains the ring and
+// does the printf/fflush, off the hot path.
+//
+// The ring lives in memory shared by all the processes (the caller maps
+// it MAP_SHARED before forking). Each slot carries a sequence number:
+// slot pos % EVENT_LOG_SLOTS is free for the producer that claimed pos
+// once seq == pos, and holds a record for the logger once seq == pos + 1.
+// Producers claim positions with a fetch-add on tail, so records come out
+// in claim order; appends made under the account lock therefore come out
+// in the order the balance changed. A full ring makes producers yield
+// until the logger catches up, so nothing is dropped.
+//
+// The logger sleeps on a futex when the ring is empty; producers only
+// touch the futex when the logger has said it is asleep.
+//
+// Robustness: a producer that dies between claiming a position and
+// publishing it would leave the logger stuck on that slot. So a producer
+// first marks the slot as being written (seq == pos | EVENT_LOG_WRITING),
+// with its pid in claimer. If the next record is still missing after
+// EVENT_LOG_STALL_MS, the logger skips the slot:
+//  - if nobody has marked it, at once. A producer that was only slow sees
+//    its position given away (seq > pos) and claims another one, so its
+//    record still comes out, just later.
+//  - if it is being written, only once the writer is gone (kill(pid, 0)),
+//    as BankLock does. That record is lost.
+// A writer that died is only gone once it has been reaped; until then it
+// is a zombie that kill() still finds. So whoever forked the producers
+// must reap them as they exit (bank_engine.c does on SIGCHLD), or a dead
+// writer's slot is never skipped.
+//
+// Needs _DEFAULT_SOURCE (or _GNU_SOURCE) for syscall().
+
+#ifndef LAB3_EVENT_LOG_H_
+#define LAB3_EVENT_LOG_H_
+
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+
+#define EVENT_LOG_SLOTS 4096
+#define EVENT_LOG_WRITING (1ul << 63)  // or'ed into seq while a producer fills the slot
+#define EVENT_LOG_STALL_MS 500
+
+typedef struct {
+    uint64_t ns;       // CLOCK_MONOTONIC when the event happened
+    int64_t balance;   // balance after the event
+    int32_t pid;       // the process appending it
+    int32_t amount;
+    int16_t student;   // account the event is about, -1 if there is only one
+    int16_t other;     // a second student (e.g. who a loan came from)
+    uint8_t role;      // the program's own role and op codes
+    uint8_t op;
+} EventRecord;
+
+typedef struct {
+    _Alignas(64) atomic_ulong seq;
+    atomic_int claimer;  // pid of the producer writing it (seq has EVENT_LOG_WRITING)
+    EventRecord rec;
+} EventSlot;
+
+typedef struct {
+    _Alignas(64) atomic_ulong tail;   // next position to claim
+    _Alignas(64) unsigned long head;  // next position to drain (logger only)
+    unsigned long stalled_head;       // logger only: head has been missing since stalled_since
+    uint64_t stalled_since;           // (0 = not waiting)
+    unsigned long skipped;            // logger only: slots given up on
+    atomic_uint logger_asleep;
+    atomic_uint wakeups;              // futex word the logger sleeps on
+    EventSlot slots[EVENT_LOG_SLOTS];
+} EventLog;
+
+static inline void EventLogInit(EventLog *log) {
+    atomic_store(&log->tail, 0);
+    log->head = 0;
+    log->stalled_head = 0;
+    log->stalled_since = 0;
+    log->skipped = 0;
+    atomic_store(&log->logger_asleep, 0);
+    atomic_store(&log->wakeups, 0);
+    for (unsigned long i = 0; i < EVENT_LOG_SLOTS; i++) {
+        atomic_store(&log->slots[i].seq, i);
+        atomic_store(&log->slots[i].claimer, 0);
+    }
+}
+
+static inline uint64_t EventLogNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Appends a copy of *r (whose pid must be the caller's). Waits (yielding)
+ * only if the ring is full.
+ */
+static inline void EventLogAppend(EventLog *log, const EventRecord *r) {
+    EventSlot *s;
+    unsigned long pos, seq;
+    for (;;) {
+        pos = atomic_fetch_add_explicit(&log->tail, 1, memory_order_relaxed);
+        s = &log->slots[pos % EVENT_LOG_SLOTS];
+        while (((seq = atomic_load_explicit(&s->seq, memory_order_acquire)) & ~EVENT_LOG_WRITING) < pos) {
+            sched_yield();
+        }
+        /* seq > pos: the logger gave up waiting for us; claim again */
+        if (seq == pos &&
+            atomic_compare_exchange_strong_explicit(&s->seq, &seq, pos | EVENT_LOG_WRITING,
+                                                    memory_order_acquire, memory_order_acquire)) {
+            break;
+        }
+    }
+    atomic_store_explicit(&s->claimer, r->pid, memory_order_relaxed);
+    s->rec = *r;
+    atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+
+    /* pairs with the fence in EventLogWait: we see it asleep or it sees our record */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&log->logger_asleep, memory_order_relaxed)) {
+        atomic_fetch_add(&log->wakeups, 1);
+        syscall(SYS_futex, &log->wakeups, FUTEX_WAKE, 1, NULL, NULL, 0);
+    }
+}
+
+static inline bool EventLogReady(EventLog *log) {
+    EventSlot *s = &log->slots[log->head % EVENT_LOG_SLOTS];
+    return atomic_load_explicit(&s->seq, memory_order_acquire) == log->head + 1;
+}
+
+/* the next record is overdue: skip its slot if its producer is slow to
+   claim it or died writing it (see the top of the file) */
+static inline bool EventLogSkipStalled(EventLog *log) {
+    if (atomic_load(&log->tail) <= log->head) {
+        log->stalled_since = 0;  // nothing claimed, nothing missing
+        return false;
+    }
+    uint64_t now = EventLogNow();
+    if (log->stalled_since == 0 || log->stalled_head != log->head) {
+        log->stalled_head = log->head;
+        log->stalled_since = now;
+        return false;
+    }
+    if (now - log->stalled_since < EVENT_LOG_STALL_MS * 1000000ull) return false;
+
+    EventSlot *s = &log->slots[log->head % EVENT_LOG_SLOTS];
+    unsigned long seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+    if (seq == (log->head | EVENT_LOG_WRITING)) {
+        pid_t pid = (pid_t)atomic_load_explicit(&s->claimer, memory_order_relaxed);
+        int saved_errno = errno;
+        bool dead = pid != 0 && kill(pid, 0) == -1 && errno == ESRCH;
+        errno = saved_errno;
+        if (!dead) return false;
+    } else if (seq != log->head) {
+        return false;  // published after all
+    }
+    if (!atomic_compare_exchange_strong(&s->seq, &seq, log->head + EVENT_LOG_SLOTS)) return false;
+    log->head++;
+    log->skipped++;
+    log->stalled_since = 0;
+    return true;
+}
+
+/**
+ * Logger side: hands every record published so far to emit(), in order,
+ * skipping any slot whose producer stalled or died (EventLogSkipStalled).
+ * Returns how many records there were.
+ */
+static inline int EventLogDrain(EventLog *log, void (*emit)(const EventRecord *)) {
+    int n = 0;
+    do {
+        while (EventLogReady(log)) {
+            EventSlot *s = &log->slots[log->head % EVENT_LOG_SLOTS];
+            EventRecord r = s->rec;
+            atomic_store_explicit(&s->seq, log->head + EVENT_LOG_SLOTS, memory_order_release);
+            log->head++;
+            log->stalled_since = 0;
+            emit(&r);
+            n++;
+        }
+    } while (EventLogSkipStalled(log));
+    return n;
+}
+
+/**
+ * Logger side: sleeps until a record may be ready, a signal arrives, or
+ * timeout_ms passes.
+ */
+static inline void EventLogWait(EventLog *log, long timeout_ms) {
+    atomic_store_explicit(&log->logger_asleep, 1, memory_order_relaxed);
+    unsigned w = atomic_load(&log->wakeups);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!EventLogReady(log)) {
+        struct timespec timeout = { timeout_ms / 1000, (timeout_ms % 1000) * 1000000L };
+        int saved_errno = errno;
+        syscall(SYS_futex, &log->wakeups, FUTEX_WAIT, w, &timeout, NULL, 0);
+        errno = saved_errno;
+    }
+    atomic_store_explicit(&log->logger_asleep, 0, memory_order_relaxed);
+}
+
+#endif  // LAB3_EVENT_LOG_H_
@@ -0,0 +1,78 @@
+// histogram.h — an HDR-style latency histogram.
+//
+// Used by BENSCHILLIBOWL's bench and kitchen and by the bank engine's
+// --bench mode. Values below 128 are counted exactly, larger ones in
+// buckets 1/64th of a power of two wide, so any recorded value is
+// reported within ~1.6% while the whole uint64_t range fits in a fixed
+// ~30KB array. Not thread safe; give each thread (or process) its own and
+// merge them afterwards. It holds no pointers, so it may live in shared
+// memory.
+
+#ifndef LAB3_HISTOGRAM_H_
+#define LAB3_HISTOGRAM_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define HISTOGRAM_BUCKETS (128 + 57 * 64)
+
+typedef struct {
+    uint64_t counts[HISTOGRAM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+static inline int HistogramBucketOf(uint64_t value) {
+    if (value < 128) return (int)value;
+    int shift = 63 - __builtin_clzll(value) - 6;  /* value >> shift is in [64, 128) */
+    return 128 + (shift - 1) * 64 + (int)((value >> shift) - 64);
+}
+
+/* largest value that lands in the bucket */
+static inline uint64_t HistogramBucketTop(int bucket) {
+    if (bucket < 128) return (uint64_t)bucket;
+    int shift = (bucket - 128) / 64 + 1;
+    uint64_t top = (uint64_t)((bucket - 128) % 64 + 64);
+    return ((top + 1) << shift) - 1;
+}
+
+static inline void HistogramReset(Histogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+static inline void HistogramRecord(Histogram *h, uint64_t value) {
+    h->counts[HistogramBucketOf(value)]++;
+    h->total++;
+    if (value > h->max) h->max = value;
+}
+
+static inline void HistogramMerge(Histogram *into, const Histogram *from) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->total += from->total;
+    if (from->max > into->max) into->max = from->max;
+}
+
+/**
+ * Returns the smallest bucket bound that at least fraction q (0..1) of the
+ * recorded values fall at or below, e.g. q = 0.99 for p99, capped at the
+ * largest value recorded. 0 when empty.
+ */
+static inline uint64_t HistogramPercentile(const Histogram *h, double q) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * (double)h->total + 0.5);
+    if (rank < 1) rank = 1;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t top = HistogramBucketTop(i);
+            return top < h->max ? top : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif  // LAB3_HISTOGRAM_H_
@@ -0,0 +1,241 @@
+// journal.h — a write-ahead journal that makes the bank balance durable.
+//
+// Used by the bank engine (--journal). bank.mem only holds the live
+// balance, which startup used to reset to 0; with a journal the balance is
+// rebuilt from bank.wal instead.
+//
+// bank.wal is memory-mapped and has two parts:
+//  - a header page with two checkpoint slots ({seq, lsn, balance}, each
+//    with a checksum; the valid one with the higher seq wins);
+//  - an array of JOURNAL_RECORDS fixed-size records. Record i of the
+//    current epoch describes operation number checkpoint.lsn + i: its
+//    delta and the balance after it.
+//
+// Appending is a few stores into the mapping, made while holding the
+// account lock (so the journal order is the balance order) and before the
+// balance itself is written: whatever the balance says, the journal said
+// first. Nothing is flushed on the hot path; a syncer thread calls
+// JournalSync() every few milliseconds, which msync()s the dirty pages of
+// every append since the last sync in one go (group commit).
+//
+// When the record array is full, the appender writes a checkpoint of the
+// current balance into the older header slot, flushes the header, and
+// starts over at record 0. Old records left behind carry LSNs that no
+// longer match their position, so replay ignores them.
+//
+// Recovery (JournalOpen on an existing file): start from the newest
+// valid checkpoint and apply records while their LSN, checksum and
+// balance chain line up; the first one that doesn't (torn, stale, or
+// never written) ends the journal.
+//
+// Needs _DEFAULT_SOURCE for MAP_* and ftruncate.
+
+#ifndef LAB3_JOURNAL_H_
+#define LAB3_JOURNAL_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define JOURNAL_FILE     "bank.wal"
+#define JOURNAL_MAGIC    0x4c41574b4e4142ull  // "BANKWAL"
+#ifndef JOURNAL_RECORDS
+#define JOURNAL_RECORDS  (1u << 20)  // 24 MB of records between checkpoints
+#endif
+#define JOURNAL_HEADER   4096
+
+typedef struct {
+    uint64_t seq;      // which checkpoint is newer; 0 = never written
+    uint64_t lsn;      // first operation not included in balance
+    int64_t balance;
+    uint64_t check;
+} JournalCheckpoint;
+
+typedef struct {
+    uint64_t lsn;
+    int64_t balance;   // after this operation
+    int32_t delta;     // + deposit, - withdrawal
+    uint32_t check;
+} JournalRecord;
+
+typedef struct {
+    uint64_t magic;
+    JournalCheckpoint ckpt[2];
+    /* live state, shared by every process; rebuilt by recovery */
+    uint64_t next_lsn;          // guarded by the account lock
+    int cur;                    // current checkpoint slot, same lock
+    atomic_ullong synced_lsn;   // everything below is on disk
+} JournalHeader;
+
+_Static_assert(sizeof(JournalHeader) <= JOURNAL_HEADER, "journal header must fit its page");
+
+typedef struct {
+    int fd;
+    JournalHeader *h;           // the start of the mapping
+    JournalRecord *records;     // JOURNAL_HEADER bytes in
+    size_t size;
+} Journal;
+
+static inline uint64_t JournalMix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline uint64_t JournalCheckpointSum(const JournalCheckpoint *c) {
+    return JournalMix(JOURNAL_MAGIC ^ c->seq ^ JournalMix(c->lsn ^ JournalMix((uint64_t)c->balance)));
+}
+
+static inline uint32_t JournalRecordSum(const JournalRecord *r) {
+    uint64_t x = JournalMix(r->lsn ^ JournalMix((uint64_t)r->balance ^ ((uint64_t)(uint32_t)r->delta << 17)));
+    return (uint32_t)(x ^ (x >> 32));
+}
+
+static inline void JournalFlushHeader(Journal *j) {
+    msync(j->h, JOURNAL_HEADER, MS_SYNC);
+}
+
+/**
+ * The balance after the last journaled operation; caller holds the
+ * account lock. Read from the records rather than cached, so it is right
+ * even after an appender died halfway through.
+ */
+static inline int64_t JournalBalance(const Journal *j) {
+    const JournalHeader *h = j->h;
+    uint64_t n = h->next_lsn - h->ckpt[h->cur].lsn;
+    return n == 0 ? h->ckpt[h->cur].balance : j->records[n - 1].balance;
+}
+
+/* writes a checkpoint of the live state into the older slot and flushes it */
+static inline void JournalWriteCheckpoint(Journal *j) {
+    JournalHeader *h = j->h;
+    int slot = h->ckpt[h->cur].seq == 0 ? h->cur : 1 - h->cur;
+    JournalCheckpoint c = { h->ckpt[h->cur].seq + 1, h->next_lsn, JournalBalance(j), 0 };
+    c.check = JournalCheckpointSum(&c);
+    h->ckpt[slot] = c;
+    __atomic_store_n(&h->cur, slot, __ATOMIC_RELEASE);
+    JournalFlushHeader(j);
+    atomic_store(&h->synced_lsn, h->next_lsn);
+}
+
+/**
+ * Rebuilds next_lsn and balance from the checkpoint and the records.
+ * Returns how many records were replayed.
+ */
+static inline uint64_t JournalRecover(Journal *j) {
+    JournalHeader *h = j->h;
+    int best = -1;
+    for (int i = 0; i < 2; i++) {
+        const JournalCheckpoint *c = &h->ckpt[i];
+        if (c->seq == 0 || c->check != JournalCheckpointSum(c)) continue;
+        if (best < 0 || c->seq > h->ckpt[best].seq) best = i;
+    }
+    if (best < 0) {
+        /* a new file, or both slots torn: an empty bank */
+        memset(h->ckpt, 0, sizeof(h->ckpt));
+        h->cur = 0;
+        h->next_lsn = 0;
+        JournalWriteCheckpoint(j);
+        return 0;
+    }
+
+    uint64_t lsn = h->ckpt[best].lsn;
+    int64_t balance = h->ckpt[best].balance;
+    uint64_t n = 0;
+    for (; n < JOURNAL_RECORDS; n++) {
+        const JournalRecord *r = &j->records[n];
+        if (r->lsn != lsn + n || r->check != JournalRecordSum(r) ||
+            r->balance != balance + r->delta) {
+            break;
+        }
+        balance = r->balance;
+    }
+    h->cur = best;
+    h->next_lsn = lsn + n;
+    atomic_store(&h->synced_lsn, lsn);
+    return n;
+}
+
+/**
+ * Opens (or creates) the journal file and recovers the balance from it.
+ * Returns false, with errno set, if the file can't be opened or mapped.
+ */
+static inline bool JournalOpen(Journal *j, const char *path, uint64_t *replayed) {
+    j->size = JOURNAL_HEADER + (size_t)JOURNAL_RECORDS * sizeof(JournalRecord);
+    j->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (j->fd < 0) return false;
+
+    struct stat st;
+    bool fresh = fstat(j->fd, &st) == 0 && st.st_size == 0;
+    if (ftruncate(j->fd, (off_t)j->size) < 0) { close(j->fd); return false; }
+
+    void *p = mmap(NULL, j->size, PROT_READ | PROT_WRITE, MAP_SHARED, j->fd, 0);
+    if (p == MAP_FAILED) { close(j->fd); return false; }
+    j->h = p;
+    j->records = (JournalRecord *)((char *)p + JOURNAL_HEADER);
+
+    if (fresh || j->h->magic != JOURNAL_MAGIC) {
+        memset(j->h, 0, JOURNAL_HEADER);
+        j->h->magic = JOURNAL_MAGIC;
+    }
+    *replayed = JournalRecover(j);
+    return true;
+}
+
+static inline void JournalClose(Journal *j) {
+    if (j->h) munmap(j->h, j->size);
+    if (j->fd >= 0) close(j->fd);
+    j->h = NULL;
+    j->fd = -1;
+}
+
+/**
+ * Journals one operation; caller holds the account lock and writes the
+ * new balance to the account only after this returns.
+ */
+static inline void JournalAppend(Journal *j, int32_t delta, int64_t new_balance) {
+    JournalHeader *h = j->h;
+    if (h->next_lsn - h->ckpt[h->cur].lsn == JOURNAL_RECORDS) JournalWriteCheckpoint(j);
+
+    JournalRecord *r = &j->records[h->next_lsn - h->ckpt[h->cur].lsn];
+    r->lsn = h->next_lsn;
+    r->balance = new_balance;
+    r->delta = delta;
+    r->check = JournalRecordSum(r);
+    __atomic_store_n(&h->next_lsn, h->next_lsn + 1, __ATOMIC_RELEASE);  // for JournalSync
+}
+
+/**
+ * Group commit: flushes every record appended since the last call.
+ * Runs outside the account lock; a stale read of next_lsn only means the
+ * newest appends wait for the next call.
+ */
+static inline void JournalSync(Journal *j) {
+    JournalHeader *h = j->h;
+    uint64_t target = __atomic_load_n(&h->next_lsn, __ATOMIC_ACQUIRE);
+    uint64_t synced = atomic_load(&h->synced_lsn);
+    if (target == synced) return;
+
+    uint64_t base = __atomic_load_n(&h->ckpt[__atomic_load_n(&h->cur, __ATOMIC_ACQUIRE)].lsn,
+                                    __ATOMIC_ACQUIRE);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t from = synced > base ? (size_t)(synced - base) : 0;
+    size_t to = target > base ? (size_t)(target - base) : 0;
+    if (to > JOURNAL_RECORDS) to = JOURNAL_RECORDS;
+    uintptr_t lo = (uintptr_t)&j->records[from] & ~(uintptr_t)(page - 1);
+    uintptr_t hi = (uintptr_t)&j->records[to];
+    if (hi > lo) msync((void *)lo, hi - lo, MS_SYNC);
+    atomic_store(&h->synced_lsn, target);
+}
+
+#endif  // LAB3_JOURNAL_H_
@@ -0,0 +1,107 @@
+// ledger.h — many bank accounts in shared memory, each with its own lock.
+//
+// Used by the bank engine (--lock ledger): one account per Poor Student,
+// so processes only contend when they touch the same student's money.
+// Every account sits on its own cache line with its own BankLock; an
+// operation on one account takes only that lock, and a transfer takes the
+// two locks lower index first, so two opposite transfers can't deadlock.
+//
+// The accounts are an array of Account in the shared segment; the helpers
+// take that array and an index.
+
+#ifndef LAB3_LEDGER_H_
+#define LAB3_LEDGER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "bank_lock.h"
+
+#define LEDGER_CACHE_LINE 64
+
+typedef struct {
+    _Alignas(LEDGER_CACHE_LINE) BankLock lock;
+    int64_t balance;  // guarded by lock
+} Account;
+
+_Static_assert(sizeof(Account) == LEDGER_CACHE_LINE, "an Account should fill one cache line");
+
+static inline void LedgerLock(Account *a) {
+    if (BankLockAcquire(&a->lock)) {
+        fprintf(stderr, "[%d] Previous holder of an account lock died; "
+                        "its balance may be stale\n", (int)getpid());
+    }
+}
+
+static inline void LedgerUnlock(Account *a) {
+    BankLockRelease(&a->lock);
+}
+
+static inline void LedgerInit(Account *accounts, int n) {
+    for (int i = 0; i < n; i++) {
+        BankLockInit(&accounts[i].lock);
+        accounts[i].balance = 0;
+    }
+}
+
+static inline int64_t LedgerBalance(Account *accounts, int idx) {
+    LedgerLock(&accounts[idx]);
+    int64_t balance = accounts[idx].balance;
+    LedgerUnlock(&accounts[idx]);
+    return balance;
+}
+
+/* adds amount to account idx; returns the new balance */
+static inline int64_t LedgerDeposit(Account *accounts, int idx, int64_t amount) {
+    LedgerLock(&accounts[idx]);
+    int64_t balance = accounts[idx].balance += amount;
+    LedgerUnlock(&accounts[idx]);
+    return balance;
+}
+
+/**
+ * Takes amount out of account idx if it holds at least that much.
+ * *balance gets the balance afterwards (or the one that was too small).
+ */
+static inline bool LedgerWithdraw(Account *accounts, int idx, int64_t amount, int64_t *balance) {
+    LedgerLock(&accounts[idx]);
+    bool ok = amount <= accounts[idx].balance;
+    if (ok) accounts[idx].balance -= amount;
+    *balance = accounts[idx].balance;
+    LedgerUnlock(&accounts[idx]);
+    return ok;
+}
+
+/**
+ * Moves amount from account `from` to account `to` if `from` holds at least
+ * that much; nobody sees the money in both or neither. *from_balance and
+ * *to_balance get the balances afterwards.
+ */
+static inline bool LedgerTransfer(Account *accounts, int from, int to, int64_t amount,
+                                  int64_t *from_balance, int64_t *to_balance) {
+    if (from == to) {
+        *from_balance = *to_balance = LedgerBalance(accounts, from);
+        return true;
+    }
+
+    Account *first  = &accounts[from < to ? from : to];
+    Account *second = &accounts[from < to ? to : from];
+    LedgerLock(first);
+    LedgerLock(second);
+
+    bool ok = amount <= accounts[from].balance;
+    if (ok) {
+        accounts[from].balance -= amount;
+        accounts[to].balance += amount;
+    }
+    *from_balance = accounts[from].balance;
+    *to_balance = accounts[to].balance;
+
+    LedgerUnlock(second);
+    LedgerUnlock(first);
+    return ok;
+}
+
+#endif  // LAB3_LEDGER_H_
@@ -0,0 +1,90 @@
+// rng.h — a small, fast random number generator with explicit state.
+//
+// Used by the bank engine and by BENSCHILLIBOWL in place of rand(), which
+// takes a lock inside glibc on every call and has one hidden state for the
+// whole process. Here every thread (or process) owns an Rng, so drawing a
+// number touches nothing shared.
+//
+// The generator is xoshiro256** (Blackman & Vigna): 256 bits of state,
+// a few shifts, rotates and multiplies per 64-bit output.
+//
+// Seeding is splittable: RngSeed(r, seed, stream) derives stream number
+// `stream` of `seed` by running both through SplitMix64. Give every
+// thread or process its own stream of one seed: the streams don't overlap
+// in practice, and the same seed always gives the same streams, so a run
+// can be repeated with --seed. RngSplit() makes a child generator from a
+// parent's next output, for when there is no natural stream number.
+
+#ifndef LAB3_RNG_H_
+#define LAB3_RNG_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+static inline uint64_t RngSplitMix(uint64_t *x) {
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline uint64_t RngRotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+/* stream `stream` of `seed`; every (seed, stream) pair gives its own sequence */
+static inline void RngSeed(Rng *r, uint64_t seed, uint64_t stream) {
+    uint64_t x = seed;
+    uint64_t mixed = RngSplitMix(&x) ^ stream;
+    x = RngSplitMix(&mixed);
+    for (int i = 0; i < 4; i++) r->s[i] = RngSplitMix(&x);
+}
+
+static inline uint64_t RngNext(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t result = RngRotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = RngRotl(s[3], 45);
+    return result;
+}
+
+/* a child generator seeded from the parent's next output */
+static inline void RngSplit(Rng *parent, Rng *child) {
+    RngSeed(child, RngNext(parent), RngNext(parent));
+}
+
+/**
+ * Uniform in [0, n) for n > 0, by multiplying instead of dividing
+ * (Lemire). The bias is below n / 2^32, far under anything a simulation
+ * could notice.
+ */
+static inline uint32_t RngBelow(Rng *r, uint32_t n) {
+    return (uint32_t)(((RngNext(r) >> 32) * (uint64_t)n) >> 32);
+}
+
+/* uniform in [lo, hi], inclusive; lo if hi < lo */
+static inline int RngRange(Rng *r, int lo, int hi) {
+    if (hi <= lo) return lo;
+    return lo + (int)RngBelow(r, (uint32_t)(hi - lo) + 1u);
+}
+
+/* a seed for runs without --seed: differs between runs and processes */
+static inline uint64_t RngDefaultSeed(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t x = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+    x ^= (uint64_t)getpid() << 32;
+    return RngSplitMix(&x);
+}
+
+#endif  // LAB3_RNG_H_